@@ -0,0 +1,320 @@
+
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <thread>
+
+#include "boggle/boggle.hpp"
+#include "boggle/compiled_trie.hpp"
+#include "boggle/mapped_file.hpp"
+#include "boggle/scoring.hpp"
+#include "boggle/solver.hpp"
+#include "boggle/word_set.hpp"
+
+#include "random_fixtures.hpp"
+
+namespace
+{
+    // The original solver, which checked the board bounds before every step and scanned the current path for revisits, kept as a baseline to measure the current one against
+    std::set<std::string> solve_with_path_scan(boggle::board<char> const& board, boggle::trie<char> const& dictionary)
+    {
+        using address = std::pair<int, int>;
+        std::string word;
+        std::vector<address> path;
+        std::set<std::string> found;
+        struct solver
+        {
+            static void solve(boggle::board<char> const& board, boggle::trie<char> const& subdictionary, std::string& word, std::vector<address>& path, address next, std::set<std::string>& found)
+            {
+                if (next.first < 0 || board.width() <= next.first || next.second < 0 || board.height() <= next.second) { return; }
+                if (std::find(path.begin(), path.end(), next) != path.end()) { return; }
+                char next_element = board(next.first, next.second);
+                auto child_dictionary = subdictionary.subtrie(next_element);
+                if (!child_dictionary) { return; }
+                word.push_back(next_element);
+                path.push_back(next);
+                if (child_dictionary->contains_this()) { found.insert(word); }
+                for (int dx = -1; dx <= 1; ++dx)
+                {
+                    for (int dy = -1; dy <= 1; ++dy)
+                    {
+                        if (dx != 0 || dy != 0) { solve(board, *child_dictionary, word, path, address{ next.first + dx, next.second + dy }, found); }
+                    }
+                }
+                path.pop_back();
+                word.pop_back();
+            }
+        };
+        for (int x = 0; x < board.width(); ++x)
+        {
+            for (int y = 0; y < board.height(); ++y)
+            {
+                solver::solve(board, dictionary, word, path, address{ x, y }, found);
+            }
+        }
+        return found;
+    }
+
+    boggle::trie<char> make_trie(std::vector<std::string> const& words)
+    {
+        boggle::trie<char> dictionary;
+        for (auto const& s : words) { dictionary.insert_sequence(s); }
+        return dictionary;
+    }
+
+    // Board side in range(0), dictionary size in range(1)
+    void BM_SolveTrie(benchmark::State& state)
+    {
+        auto board = make_random_board(state.range(0), state.range(0), 1);
+        auto dictionary = make_trie(make_random_words(state.range(1), 2));
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(boggle::solve(board, dictionary));
+        }
+        state.SetItemsProcessed(state.iterations() * board.width() * board.height());
+    }
+    BENCHMARK(BM_SolveTrie)->Args({ 50, 2500 })->Args({ 50, 200000 })->Args({ 100, 200000 })->Unit(benchmark::kMillisecond);
+
+    void BM_SolveTriePathScan(benchmark::State& state)
+    {
+        auto board = make_random_board(state.range(0), state.range(0), 1);
+        auto dictionary = make_trie(make_random_words(state.range(1), 2));
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(solve_with_path_scan(board, dictionary));
+        }
+        state.SetItemsProcessed(state.iterations() * board.width() * board.height());
+    }
+    BENCHMARK(BM_SolveTriePathScan)->Args({ 50, 2500 })->Args({ 50, 200000 })->Unit(benchmark::kMillisecond);
+
+    void BM_SolveCompiledTrie(benchmark::State& state)
+    {
+        auto board = make_random_board(state.range(0), state.range(0), 1);
+        auto words = make_random_words(state.range(1), 2);
+        boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(boggle::solve(board, dictionary));
+        }
+        state.SetItemsProcessed(state.iterations() * board.width() * board.height());
+    }
+    BENCHMARK(BM_SolveCompiledTrie)->Args({ 50, 2500 })->Args({ 50, 200000 })->Args({ 100, 200000 })->Unit(benchmark::kMillisecond);
+
+    // The explicit-stack engine, with no limits
+    void BM_SolveCompiledTrieIterative(benchmark::State& state)
+    {
+        auto board = make_random_board(state.range(0), state.range(0), 1);
+        auto words = make_random_words(state.range(1), 2);
+        boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(boggle::solve(board, dictionary, boggle::search_options{}));
+        }
+        state.SetItemsProcessed(state.iterations() * board.width() * board.height());
+    }
+    BENCHMARK(BM_SolveCompiledTrieIterative)->Args({ 50, 2500 })->Args({ 50, 200000 })->Args({ 100, 200000 })->Unit(benchmark::kMillisecond);
+
+    // The explicit-stack engine, only looking for words of 5 letters or more, up to the given length in range(0)
+    void BM_SolveCompiledTrieLimited(benchmark::State& state)
+    {
+        auto board = make_random_board(50, 50, 1);
+        auto words = make_random_words(200000, 2);
+        boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+        boggle::search_options options;
+        options.min_length = 5;
+        options.max_length = state.range(0);
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(boggle::solve(board, dictionary, options));
+        }
+        state.SetItemsProcessed(state.iterations() * board.width() * board.height());
+    }
+    BENCHMARK(BM_SolveCompiledTrieLimited)->Arg(5)->Arg(6)->Arg(7)->Unit(benchmark::kMillisecond);
+
+    // Collecting into a word_set instead of a set of strings, reusing the one set throughout
+    void BM_SolveWordSet(benchmark::State& state)
+    {
+        auto board = make_random_board(state.range(0), state.range(0), 1);
+        auto words = make_random_words(state.range(1), 2);
+        boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+        boggle::word_set<boggle::compiled_trie<char>> found{ dictionary };
+        for (auto _ : state)
+        {
+            found.clear();
+            boggle::solve(board, dictionary, found);
+            benchmark::DoNotOptimize(found.size());
+        }
+        state.SetItemsProcessed(state.iterations() * board.width() * board.height());
+    }
+    BENCHMARK(BM_SolveWordSet)->Args({ 50, 2500 })->Args({ 50, 200000 })->Args({ 100, 200000 })->Unit(benchmark::kMillisecond);
+
+    // Thread count in range(0), on a 100x100 board with a 200k word dictionary
+    void BM_SolveParallel(benchmark::State& state)
+    {
+        auto board = make_random_board(100, 100, 1);
+        auto words = make_random_words(200000, 2);
+        boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(boggle::solve(board, dictionary, static_cast<unsigned>(state.range(0))));
+        }
+        state.SetItemsProcessed(state.iterations() * board.width() * board.height());
+    }
+    BENCHMARK(BM_SolveParallel)->DenseRange(1, std::max(1u, std::thread::hardware_concurrency()))->UseRealTime()->Unit(benchmark::kMillisecond);
+
+    // Solving a batch of 1000 standard-size boards (side in range(0)) against a 200k word dictionary, one solve() call per board; items per second is boards per second
+    void BM_SolveEachBoard(benchmark::State& state)
+    {
+        auto words = make_random_words(200000, 2);
+        boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+        std::vector<boggle::board<char>> boards;
+        for (unsigned i = 0; i < 1000; ++i) { boards.push_back(make_random_board(state.range(0), state.range(0), i)); }
+        for (auto _ : state)
+        {
+            for (auto const& board : boards)
+            {
+                benchmark::DoNotOptimize(boggle::solve(board, dictionary));
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * boards.size());
+    }
+    BENCHMARK(BM_SolveEachBoard)->Arg(4)->Arg(5)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+    // The same batch through a solver with the thread count in range(1)
+    void BM_SolveBatch(benchmark::State& state)
+    {
+        auto words = make_random_words(200000, 2);
+        boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+        std::vector<boggle::board<char>> boards;
+        for (unsigned i = 0; i < 1000; ++i) { boards.push_back(make_random_board(state.range(0), state.range(0), i)); }
+        boggle::solver<boggle::compiled_trie<char>> solver{ dictionary, static_cast<unsigned>(state.range(1)) };
+        std::vector<boggle::solver<boggle::compiled_trie<char>>::result> results(boards.size());
+        for (auto _ : state)
+        {
+            solver.solve(boards.begin(), boards.end(), results.begin());
+            benchmark::DoNotOptimize(results.data());
+        }
+        state.SetItemsProcessed(state.iterations() * boards.size());
+    }
+    BENCHMARK(BM_SolveBatch)->ArgsProduct({ { 4, 5 }, benchmark::CreateDenseRange(1, std::max(1u, std::thread::hardware_concurrency()), 1) })->UseRealTime()->Unit(benchmark::kMillisecond);
+
+    // The k best-scoring words (k in range(1)), on a board of side range(0), against a 200k word dictionary
+    void BM_SolveTop(benchmark::State& state)
+    {
+        auto board = make_random_board(state.range(0), state.range(0), 1);
+        auto words = make_random_words(200000, 2);
+        boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+        boggle::scored_dictionary<char> scored{ dictionary };
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(boggle::solve_top(board, scored, state.range(1)));
+        }
+        state.SetItemsProcessed(state.iterations() * board.width() * board.height());
+    }
+    BENCHMARK(BM_SolveTop)->ArgsProduct({ { 5, 50, 100 }, { 1, 10, 100 } })->Unit(benchmark::kMillisecond);
+
+    // The same, by finding every word (with the solver, which doesn't allocate), then scoring and sorting them all; this doesn't find the paths
+    void BM_SolveAllThenSort(benchmark::State& state)
+    {
+        auto board = make_random_board(state.range(0), state.range(0), 1);
+        auto words = make_random_words(200000, 2);
+        boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+        boggle::scored_dictionary<char> scored{ dictionary };
+        boggle::solver<boggle::compiled_trie<char>> solver{ dictionary };
+        boggle::solver<boggle::compiled_trie<char>>::result found;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> ranked;
+        for (auto _ : state)
+        {
+            solver.solve(board, found);
+            ranked.clear();
+            for (auto id : found) { ranked.emplace_back(scored.score(id), id); }
+            std::sort(ranked.begin(), ranked.end(), [](auto const& a, auto const& b) { return a.first > b.first || (a.first == b.first && a.second < b.second); });
+            ranked.resize(std::min<std::size_t>(ranked.size(), state.range(1)));
+            benchmark::DoNotOptimize(ranked.data());
+        }
+        state.SetItemsProcessed(state.iterations() * board.width() * board.height());
+    }
+    BENCHMARK(BM_SolveAllThenSort)->ArgsProduct({ { 5, 50, 100 }, { 1, 10, 100 } })->Unit(benchmark::kMillisecond);
+
+    // Inserting words one at a time; dictionary size in range(0)
+    void BM_BuildTrie(benchmark::State& state)
+    {
+        auto words = make_random_words(state.range(0), 2);
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(make_trie(words));
+        }
+        state.SetItemsProcessed(state.iterations() * words.size());
+    }
+    BENCHMARK(BM_BuildTrie)->Arg(2500)->Arg(200000)->Unit(benchmark::kMillisecond);
+
+    // The same words built in bulk: dictionary size in range(0), whether the words are already sorted in range(1), thread count in range(2)
+    void BM_BuildTrieBulk(benchmark::State& state)
+    {
+        auto words = make_random_words(state.range(0), 2);
+        if (state.range(1)) { std::sort(words.begin(), words.end()); }
+        for (auto _ : state)
+        {
+            boggle::trie<char> dictionary{ words.begin(), words.end(), static_cast<unsigned>(state.range(2)) };
+            benchmark::DoNotOptimize(dictionary);
+        }
+        state.SetItemsProcessed(state.iterations() * words.size());
+    }
+    BENCHMARK(BM_BuildTrieBulk)->ArgsProduct({ { 2500, 200000 }, { 0, 1 }, { 1 } })->Unit(benchmark::kMillisecond);
+    BENCHMARK(BM_BuildTrieBulk)->ArgsProduct({ { 200000 }, { 0, 1 }, benchmark::CreateDenseRange(2, std::max(2u, std::thread::hardware_concurrency()), 1) })->UseRealTime()->Unit(benchmark::kMillisecond);
+
+    // Loading a word list file (one word per line, unsorted) straight into a trie; dictionary size in range(0)
+    void BM_LoadTrie(benchmark::State& state)
+    {
+        auto words = make_random_words(state.range(0), 2);
+        auto path = std::string{ "boggle-bench.words" };
+        {
+            std::ofstream file{ path };
+            for (auto const& w : words) { file << w << '\n'; }
+        }
+        for (auto _ : state)
+        {
+            auto dictionary = boggle::trie<char>::load(path);
+            benchmark::DoNotOptimize(dictionary);
+        }
+        std::remove(path.c_str());
+        state.SetItemsProcessed(state.iterations() * words.size());
+    }
+    BENCHMARK(BM_LoadTrie)->Arg(200000)->Unit(benchmark::kMillisecond);
+
+    void BM_BuildCompiledTrie(benchmark::State& state)
+    {
+        auto words = make_random_words(state.range(0), 2);
+        for (auto _ : state)
+        {
+            boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+            benchmark::DoNotOptimize(dictionary);
+            state.counters["nodes"] = dictionary.node_count();
+        }
+        state.SetItemsProcessed(state.iterations() * words.size());
+    }
+    BENCHMARK(BM_BuildCompiledTrie)->Arg(2500)->Arg(200000)->Unit(benchmark::kMillisecond);
+
+    // Startup from a dictionary file saved ahead of time, compared with building the dictionary above; dictionary size in range(0)
+    void BM_MapDictionary(benchmark::State& state)
+    {
+        auto words = make_random_words(state.range(0), 2);
+        auto path = std::string{ "boggle-bench.dict" };
+        {
+            std::ofstream file{ path, std::ios::binary };
+            boggle::compiled_trie<char>{ words.begin(), words.end() }.save(file);
+        }
+        for (auto _ : state)
+        {
+            auto dictionary = boggle::map_dictionary<char>(path);
+            benchmark::DoNotOptimize(dictionary);
+        }
+        std::remove(path.c_str());
+        state.SetItemsProcessed(state.iterations() * words.size());
+    }
+    BENCHMARK(BM_MapDictionary)->Arg(2500)->Arg(200000)->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK_MAIN();
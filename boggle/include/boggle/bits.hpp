@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace boggle
+{
+    namespace detail
+    {
+        inline unsigned popcount(std::uint64_t bits)
+        {
+#if defined(_MSC_VER)
+            return static_cast<unsigned>(__popcnt64(bits));
+#else
+            return static_cast<unsigned>(__builtin_popcountll(bits));
+#endif
+        }
+
+        // The index of the lowest set bit; bits must not be zero
+        inline unsigned count_trailing_zeros(std::uint64_t bits)
+        {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward64(&index, bits);
+            return static_cast<unsigned>(index);
+#else
+            return static_cast<unsigned>(__builtin_ctzll(bits));
+#endif
+        }
+    }
+}
@@ -1,11 +1,21 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
+#include <exception>
+#include <fstream>
 #include <iostream>
-#include <map>
+#include <iterator>
+#include <limits>
 #include <memory>
 #include <set>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
 namespace boggle
@@ -19,7 +29,7 @@ namespace boggle
 
         board(int width, int height) : _width{width}, _height{height}
         {
-            _values.resize(_width * _height);
+            _values.resize((_width + 2) * (_height + 2));
         }
 
         board() : board{ 0, 0 } {}
@@ -30,35 +40,40 @@ namespace boggle
         char_t& operator()(int x, int y) { return _values[index(x,y)]; }
         char_t const& operator()(int x, int y) const { return _values[index(x,y)]; }
 
+        // Unchecked access, for the solver. The cells are stored row by row, with a one-cell border (of char_t{}) all the way round, so every cell on the board has all eight of its neighbours in storage, at fixed offsets: one step in y is stride() cells. cell() works for x from -1 to width() and y from -1 to height(), to reach the border.
+        int stride() const { return _width + 2; }
+        int cell_count() const { return static_cast<int>(_values.size()); }
+        int cell(int x, int y) const { return (y + 1) * stride() + (x + 1); }
+        char_t const& at(int cell) const { return _values[cell]; }
+
         friend std::basic_ostream<char_t>& operator<<(std::basic_ostream<char_t>& s, board const& b)
         {
             for (auto y = 0; y < b._height; ++y)
             {
-                s << std::basic_string<char_t>{ b._values.begin() + (y * b._width), b._values.begin() + ((y+1) * b._width) } << std::endl;
+                auto row = b._values.begin() + b.cell(0, y);
+                s << std::basic_string<char_t>{ row, row + b._width } << std::endl;
             }
             return s;
         }
 
         friend std::basic_istream<char_t>& operator>>(std::basic_istream<char_t>& s, board& b)
         {
-            b._width = 0;
-            b._height = 0;
-            b._values.clear();
+            std::vector<std::basic_string<char_t>> lines;
             while (true)
             {
                 std::basic_string<char_t> line;
                 std::getline(s, line);
                 if (line.length() == 0) { break; }
-                if (b._width == 0)
-                {
-                    b._width = line.length();
-                }
-                else if (b._width != line.length())
+                if (!lines.empty() && lines.front().length() != line.length())
                 {
                     throw std::runtime_error("nonrectangular input");
                 }
-                b._values.insert(b._values.end(), line.begin(), line.end());
-                ++b._height;
+                lines.push_back(std::move(line));
+            }
+            b = board{ lines.empty() ? 0 : static_cast<int>(lines.front().length()), static_cast<int>(lines.size()) };
+            for (auto y = 0; y < b._height; ++y)
+            {
+                std::copy(lines[y].begin(), lines[y].end(), b._values.begin() + b.cell(0, y));
             }
             return s;
         }
@@ -72,25 +87,95 @@ namespace boggle
         {
             if (x < 0 || _width <= x) { throw std::out_of_range("x out of range"); }
             if (y < 0 || _height <= y) { throw std::out_of_range("y out of range"); }
-            return y * _width + x;
+            return cell(x, y);
         }
     };
 
     // A trie - one way of representing a set of sequences (ie, a dictionary) that happens to be super efficient for solving a Boggle board
+    //
+    // The nodes all come from an arena owned by the root, in blocks, and each node's children sit next to each other in it, in letter order, so finding a child is a binary search of one small array, and nothing is freed until the whole trie goes. (Inserting a word can move a node's children, so it invalidates subtrie() pointers.)
     template<typename TChar>
     class trie
     {
     public:
         using char_t = TChar;
 
+        trie() = default;
+
+        // Build a trie from a list of words in one go, in any order and possibly with repeats. Words which are already sorted are fastest: each node's children are then made together, in one run from the arena, in a single pass over the list. With more than one thread, the words are split up by their first letter, and each thread builds whole subtries of the root, each with an arena of its own.
+        template<typename TIter>
+        trie(TIter begin, TIter end, unsigned thread_count = 1)
+        {
+            _arena = std::make_unique<node_arena>();
+            auto sorted = std::is_sorted(begin, end, [](auto const& a, auto const& b)
+            {
+                return std::lexicographical_compare(std::begin(a), std::end(a), std::begin(b), std::end(b), [](char_t x, char_t y) { return std::char_traits<char_t>::lt(x, y); });
+            });
+
+            // Inserting unsorted words one at a time, straight from the list, beats sorting them first
+            if (!sorted && thread_count <= 1)
+            {
+                for (auto i = begin; i != end; ++i) { insert(std::begin(*i), std::end(*i), *_arena); }
+                return;
+            }
+
+            std::vector<std::basic_string<char_t>> words;
+            for (auto i = begin; i != end; ++i)
+            {
+                words.emplace_back(std::begin(*i), std::end(*i));
+            }
+            build(words, sorted, thread_count);
+        }
+
+        trie(trie&& other) noexcept { *this = std::move(other); }
+
+        trie& operator=(trie&& other) noexcept
+        {
+            _letter = other._letter;
+            _contains_this = other._contains_this;
+            _child_count = other._child_count;
+            _child_capacity = other._child_capacity;
+            _children = other._children;
+            _arena = std::move(other._arena);
+            other._contains_this = false;
+            other._child_count = 0;
+            other._child_capacity = 0;
+            other._children = nullptr;
+            return *this;
+        }
+
+        // Build a trie from a word list, one word per line (as the boggle-compile-dictionary tool takes)
+        static trie read(std::basic_istream<char_t>& s, unsigned thread_count = 1)
+        {
+            std::basic_string<char_t> text{ std::istreambuf_iterator<char_t>{ s }, std::istreambuf_iterator<char_t>{} };
+            std::vector<std::basic_string<char_t>> words;
+            for (std::size_t i = 0; i < text.length();)
+            {
+                auto j = std::min(text.find(char_t('\n'), i), text.length());
+                auto k = (j > i && text[j - 1] == char_t('\r')) ? j - 1 : j;
+                if (k > i) { words.emplace_back(text, i, k - i); }
+                i = j + 1;
+            }
+            trie result;
+            result._arena = std::make_unique<node_arena>();
+            result.build(words, std::is_sorted(words.begin(), words.end()), thread_count);
+            return result;
+        }
+
+        static trie load(std::string const& path, unsigned thread_count = 1)
+        {
+            std::basic_ifstream<char_t> s{ path, std::ios::binary };
+            if (!s) { throw std::runtime_error("can't open " + path); }
+            return read(s, thread_count);
+        }
+
         template<typename TIter>
         bool contains_sequence(TIter const& begin, TIter const& end) const
         {
             if (begin == end) { return _contains_this; }
-            auto i = _children.find(*begin);
-            if (i == _children.end()) { return false; }
-            assert(i->second);
-            return i->second->contains_sequence(std::next(begin), end);
+            auto child = subtrie(*begin);
+            if (!child) { return false; }
+            return child->contains_sequence(std::next(begin), end);
         }
 
         template<typename TSeq>
@@ -101,99 +186,583 @@ namespace boggle
         template<typename TIter>
         void insert_sequence(TIter const& begin, TIter const& end)
         {
-            if (begin == end)
+            if (!_arena) { _arena = std::make_unique<node_arena>(); }
+            insert(begin, end, *_arena);
+        }
+
+        template<typename TSeq>
+        void insert_sequence(TSeq const& seq) { insert_sequence(std::begin(seq), std::end(seq)); }
+
+        trie<char_t> const* subtrie(char_t index) const
+        {
+            auto end = _children + _child_count;
+            auto i = std::lower_bound(_children, end, index, letter_less);
+            return (i == end || i->_letter != index) ? nullptr : i;
+        }
+
+        // Visit each (letter, subtrie) pair directly below this node, in letter order
+        template<typename TFunc>
+        void for_each_child(TFunc&& f) const
+        {
+            for (auto child = _children; child != _children + _child_count; ++child)
+            {
+                f(child->_letter, *child);
+            }
+        }
+
+    private:
+        // Hands out nodes in runs, from blocks which are only freed along with the arena
+        class node_arena
+        {
+        public:
+            trie* allocate(std::size_t count)
+            {
+                if (_used + count > _capacity)
+                {
+                    _capacity = std::max(block_size, count);
+                    _blocks.push_back(std::make_unique<trie[]>(_capacity));
+                    _used = 0;
+                }
+                auto nodes = _blocks.back().get() + _used;
+                _used += count;
+                return nodes;
+            }
+
+            // Take over another arena's blocks (without using the space left in them)
+            void adopt(node_arena& other)
+            {
+                _blocks.insert(_blocks.begin(), std::make_move_iterator(other._blocks.begin()), std::make_move_iterator(other._blocks.end()));
+                other._blocks.clear();
+                other._used = other._capacity = 0;
+            }
+
+        private:
+            static constexpr std::size_t block_size = 4096;
+
+            std::vector<std::unique_ptr<trie[]>> _blocks;
+            std::size_t _used = 0;
+            std::size_t _capacity = 0;
+        };
+
+        // Part of the sorted word list, all sharing a prefix of the given length, whose node is the given one
+        struct span
+        {
+            trie* node;
+            std::size_t begin;
+            std::size_t end;
+            std::size_t depth;
+        };
+
+        char_t _letter{};
+        bool _contains_this = false;
+        std::uint32_t _child_count = 0;
+        std::uint32_t _child_capacity = 0;
+        trie* _children = nullptr;
+
+        // Only the root has one
+        std::unique_ptr<node_arena> _arena;
+
+        // Letters are ordered the same way the strings holding them are
+        static bool letter_less(trie const& node, char_t c) { return std::char_traits<char_t>::lt(node._letter, c); }
+
+        // Find the child for a letter, adding it if there isn't one. A full set of children moves to a new run of twice the size.
+        trie& insert_child(char_t c, node_arena& arena)
+        {
+            auto end = _children + _child_count;
+            auto i = std::lower_bound(_children, end, c, letter_less);
+            if (i != end && i->_letter == c) { return *i; }
+
+            auto position = i - _children;
+            if (_child_count == _child_capacity)
             {
-                _contains_this = true;
+                auto capacity = (_child_capacity == 0) ? 1 : 2 * _child_capacity;
+                auto children = arena.allocate(capacity);
+                std::move(_children, end, children);
+                _children = children;
+                _child_capacity = capacity;
+            }
+            auto child = _children + position;
+            std::move_backward(child, _children + _child_count, _children + _child_count + 1);
+            *child = trie{};
+            child->_letter = c;
+            ++_child_count;
+            return *child;
+        }
+
+        template<typename TIter>
+        void insert(TIter const& begin, TIter const& end, node_arena& arena)
+        {
+            auto node = this;
+            for (auto i = begin; i != end; ++i)
+            {
+                node = &node->insert_child(*i, arena);
+            }
+            node->_contains_this = true;
+        }
+
+        // Sorted words are laid out directly, one node at a time; otherwise, they're inserted one at a time (which is quicker than sorting them first)
+        void build(std::vector<std::basic_string<char_t>>& words, bool sorted, unsigned thread_count)
+        {
+            if (thread_count <= 1)
+            {
+                if (sorted) { layout(span{ this, 0, words.size(), 0 }, words, *_arena); }
+                else
+                {
+                    for (auto const& w : words) { insert(w.begin(), w.end(), *_arena); }
+                }
                 return;
             }
-            auto i = _children.find(*begin);
-            if (i == _children.end())
+
+            if (sorted)
             {
-                std::tie(i, std::ignore) = _children.emplace(*begin, std::make_unique<trie<char_t>>());
+                auto bounds = add_first_letters(words.size(), [&words](std::size_t i) -> std::basic_string<char_t> const& { return words[i]; });
+                build_subtries(thread_count, [&](std::size_t g, node_arena& arena)
+                {
+                    layout(span{ _children + g, bounds[g], bounds[g + 1], 1 }, words, arena);
+                });
+                return;
             }
-            assert(i->second);
-            i->second->insert_sequence(std::next(begin), end);
+
+            // Only put the words in order of their first letter (which is cheap, compared with sorting them)
+            std::vector<std::size_t> order(words.size());
+            for (std::size_t i = 0; i < order.size(); ++i) { order[i] = i; }
+            std::sort(order.begin(), order.end(), [&words](std::size_t a, std::size_t b)
+            {
+                return !words[b].empty() && (words[a].empty() || std::char_traits<char_t>::lt(words[a][0], words[b][0]));
+            });
+            auto bounds = add_first_letters(order.size(), [&words, &order](std::size_t i) -> std::basic_string<char_t> const& { return words[order[i]]; });
+            build_subtries(thread_count, [&](std::size_t g, node_arena& arena)
+            {
+                for (auto i = bounds[g]; i != bounds[g + 1]; ++i)
+                {
+                    auto const& w = words[order[i]];
+                    _children[g].insert(std::next(w.begin()), w.end(), arena);
+                }
+            });
         }
 
-        template<typename TSeq>
-        void insert_sequence(TSeq const& seq) { insert_sequence(std::begin(seq), std::end(seq)); }
+        // Give the root a child for each first letter of the words (which must be grouped by first letter), returning where each child's group of words starts, and where the last one ends
+        template<typename TWord>
+        std::vector<std::size_t> add_first_letters(std::size_t count, TWord&& word)
+        {
+            std::size_t first = 0;
+            for (; first != count && word(first).empty(); ++first) { _contains_this = true; }
+            std::vector<std::size_t> bounds;
+            for (auto i = first; i != count; ++i)
+            {
+                if (i == first || word(i)[0] != word(i - 1)[0]) { bounds.push_back(i); }
+            }
+            _children = _arena->allocate(bounds.size());
+            _child_count = _child_capacity = static_cast<std::uint32_t>(bounds.size());
+            for (std::size_t g = 0; g < bounds.size(); ++g) { _children[g]._letter = word(bounds[g])[0]; }
+            bounds.push_back(count);
+            return bounds;
+        }
 
-        trie<char_t> const* subtrie(char_t index) const
+        // Build the subtries of the root on the given number of threads (counting the calling thread), each with an arena of its own. Subtries vary a lot in size, so each thread keeps taking the next unclaimed one until there are none left.
+        template<typename TFunc>
+        void build_subtries(unsigned thread_count, TFunc&& build_subtrie)
         {
-            auto i = _children.find(index);
-            return (i == _children.end()) ? nullptr : i->second.get();
+            std::vector<node_arena> arenas(thread_count);
+            std::vector<std::exception_ptr> errors(thread_count);
+            std::atomic<std::size_t> next_child{ 0 };
+            auto work = [&](unsigned i)
+            {
+                try
+                {
+                    for (auto g = next_child++; g < _child_count; g = next_child++)
+                    {
+                        build_subtrie(g, arenas[i]);
+                    }
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                    next_child = _child_count;
+                }
+            };
+
+            std::vector<std::thread> threads;
+            try
+            {
+                for (unsigned i = 1; i < std::min<std::size_t>(thread_count, _child_count); ++i) { threads.emplace_back(work, i); }
+            }
+            catch (...)
+            {
+                errors[0] = std::current_exception();
+                next_child = _child_count;
+            }
+            work(0);
+            for (auto& thread : threads) { thread.join(); }
+            for (auto& arena : arenas) { _arena->adopt(arena); }
+            for (auto const& error : errors)
+            {
+                if (error) { std::rethrow_exception(error); }
+            }
         }
 
-    private:
-        bool _contains_this;
-        std::map<char_t, std::unique_ptr<trie<char_t>>> _children;
+        // Build the subtrie for part of the sorted word list, depth first, making all of each node's children in one run
+        static void layout(span root, std::vector<std::basic_string<char_t>> const& words, node_arena& arena)
+        {
+            std::vector<span> pending{ root };
+            while (!pending.empty())
+            {
+                auto current = pending.back();
+                pending.pop_back();
+
+                // Sorting puts the word that is exactly this prefix (and any repeats of it) first in the range
+                auto begin = current.begin;
+                for (; begin != current.end && words[begin].length() == current.depth; ++begin) { current.node->_contains_this = true; }
+
+                std::uint32_t count = 0;
+                for (auto i = begin; i != current.end; ++i)
+                {
+                    if (i == begin || words[i][current.depth] != words[i - 1][current.depth]) { ++count; }
+                }
+                if (count == 0) { continue; }
+
+                auto child = arena.allocate(count);
+                current.node->_children = child;
+                current.node->_child_count = current.node->_child_capacity = count;
+                for (auto i = begin; i != current.end; ++child)
+                {
+                    auto c = words[i][current.depth];
+                    auto j = i;
+                    while (j != current.end && words[j][current.depth] == c) { ++j; }
+                    child->_letter = c;
+                    pending.push_back(span{ child, i, j, current.depth + 1 });
+                    i = j;
+                }
+            }
+        }
     };
 
-    // Do a depth-first search among the space of all legal paths through the given Boggle board, with some very agressive trimming of the search tree
     template<typename TChar>
-    std::set<std::basic_string<TChar>> solve(board<TChar> const& board, trie<TChar> const& dictionary)
+    constexpr std::size_t trie<TChar>::node_arena::block_size;
+
+    // All the solver needs from a dictionary is a way to walk it one letter at a time: start at the root, step to the child for a letter (if there is one), and ask whether the node reached completes a word. The default here walks anything shaped like trie, by following subtrie() pointers; other dictionary types specialize this.
+    template<typename TDictionary>
+    struct dictionary_traits
     {
+        using char_t = typename TDictionary::char_t;
+        using node_type = TDictionary const*;
 
-        using char_t = TChar;
-        using address = std::pair<int, int>;
+        static node_type root(TDictionary const& dictionary) { return &dictionary; }
+        static node_type child(TDictionary const&, node_type node, char_t c) { return node->subtrie(c); }
+        static bool contains_word(TDictionary const&, node_type node) { return node->contains_this(); }
+        static bool is_node(node_type node) { return node != nullptr; }
+    };
 
-        // For efficiency, we're going to have a bit of state which is global across the search: the current path, and the word represented by that path. (It's much more efficient to modify these in-place as we go, rather than allocate and modify copies.
-        std::basic_string<char_t> word;
-        std::vector<address> path;
+    // Limits on the words a search looks for: no path is followed further than max_length letters, and words shorter than min_length aren't reported (though the paths through them are still followed)
+    struct search_options
+    {
+        std::size_t min_length = 0;
+        std::size_t max_length = std::numeric_limits<std::size_t>::max();
+    };
+
+    namespace detail
+    {
+        // A set of board cells, one bit per cell, so adding, removing and testing a cell are all constant-time
+        class cell_set
+        {
+        public:
+            explicit cell_set(int size = 0) { reset(size); }
 
-        // We're also going to globally track the set of valid words found so far
-        std::set<std::basic_string<char_t>> found;
+            // Empty the set, and size it to hold the given number of cells
+            void reset(int size) { _bits.assign((size + 63) / 64, 0); }
 
-        // The actual recursive function. It's a static method in an inner struct, since C++ doesn't let us nest functions directly.
-        struct solver
+            bool contains(int cell) const { return (_bits[cell / 64] & bit(cell)) != 0; }
+            void insert(int cell) { _bits[cell / 64] |= bit(cell); }
+            void erase(int cell) { _bits[cell / 64] &= ~bit(cell); }
+
+        private:
+            std::vector<std::uint64_t> _bits;
+
+            static std::uint64_t bit(int cell) { return std::uint64_t{ 1 } << (cell % 64); }
+        };
+
+        // Collects the words found into a sorted set of strings
+        template<typename TChar>
+        class string_collector
         {
-            static void solve(boggle::board<char_t> const& board, trie<char_t> const& subdictionary, std::basic_string<char_t>& word, std::vector<address>& path, address next, std::set<std::basic_string<char_t>>& found)
+        public:
+            template<typename TNode>
+            void operator()(TNode, std::basic_string<TChar> const& word) { _words.insert(word); }
+
+            std::set<std::basic_string<TChar>>& words() { return _words; }
+
+        private:
+            std::set<std::basic_string<TChar>> _words;
+        };
+
+        // A collector which wants the path of each word found as well (the cells spelling it out, from the first letter to the last) says so with a static wants_path = true, and is passed the cells as a third argument. Others don't pay for keeping track of them.
+        template<typename TCollector, typename = void>
+        struct wants_path : std::false_type {};
+
+        template<typename TCollector>
+        struct wants_path<TCollector, std::enable_if_t<TCollector::wants_path>> : std::true_type {};
+
+        // The state for one depth-first search among the space of all legal paths through a Boggle board. Each word found is passed to the collector, along with its dictionary node. Independent searchers over the same board and dictionary don't share anything mutable, so they can run on separate threads.
+        //
+        // There are two engines, which find exactly the same words: a straightforward recursive one, and one which keeps the path on an explicit stack of fixed size, and can cut the search off at a maximum word length.
+        template<typename TChar, typename TDictionary, typename TCollector = string_collector<TChar>>
+        class searcher
+        {
+        public:
+            using char_t = TChar;
+
+            template<typename... TArgs>
+            explicit searcher(TDictionary const& dictionary, TArgs&&... collector_args) : _dictionary{ dictionary }, _found{ std::forward<TArgs>(collector_args)... } {}
+
+            // Switch to the explicit-stack engine, with the given limits on the words it looks for
+            void limit(search_options const& options)
+            {
+                _options = options;
+                _iterative = true;
+            }
+
+            // Get ready to search the given board (which must outlive the search)
+            void reset(boggle::board<char_t> const& board)
+            {
+                _board = &board;
+                _path.clear();
+
+                // A path can't be longer than the number of cells on the board, so that bounds the stack too
+                if (_iterative)
+                {
+                    auto depth = std::min<std::size_t>(_options.max_length, static_cast<std::size_t>(board.width()) * board.height());
+                    _stack.resize(depth);
+                    _word.reserve(depth);
+                }
+
+                // Fence the board in: with the border cells marked as already visited, no path can ever step off the board, so there's no need to check for that
+                _visited.reset(board.cell_count());
+                for (int x = -1; x <= board.width(); ++x)
+                {
+                    _visited.insert(board.cell(x, -1));
+                    _visited.insert(board.cell(x, board.height()));
+                }
+                for (int y = 0; y < board.height(); ++y)
+                {
+                    _visited.insert(board.cell(-1, y));
+                    _visited.insert(board.cell(board.width(), y));
+                }
+
+                auto stride = board.stride();
+                _steps = { { -stride - 1, -stride, -stride + 1, -1, 1, stride - 1, stride, stride + 1 } };
+            }
+
+            // Try all the paths which start from the given cell
+            void search_from(int start)
             {
-                // Is the proposed next space off the board? If not, illegal path
-                if (next.first < 0 || board.width() <= next.first || next.second < 0 || board.height() <= next.second) { return; }
+                if (_iterative) { iterate(start); }
+                else { solve(traits::root(_dictionary), start); }
+            }
 
+            // Try all the paths which start from the given rows
+            void search_rows(int first, int last)
+            {
+                for (int y = first; y < last; ++y)
+                {
+                    for (auto cell = _board->cell(0, y); cell < _board->cell(_board->width(), y); ++cell)
+                    {
+                        search_from(cell);
+                    }
+                }
+            }
+
+            TCollector& found() { return _found; }
+
+        private:
+            using traits = dictionary_traits<TDictionary>;
+            using node_type = typename traits::node_type;
+
+            boggle::board<char_t> const* _board = nullptr;
+            TDictionary const& _dictionary;
+
+            // The offsets to the eight neighbouring cells
+            std::array<int, 8> _steps;
+
+            // For efficiency, we're going to have a bit of state which is global across the search: the cells on the current path, and the word represented by that path. (It's much more efficient to modify these in-place as we go, rather than allocate and modify copies.
+            std::basic_string<char_t> _word;
+            cell_set _visited;
+
+            // We're also going to globally track the valid words found so far
+            TCollector _found;
+
+            // The cells on the current path, in order, for collectors which want them
+            std::vector<int> _path;
+
+            // For the explicit-stack engine, each entry on the path records its cell, the dictionary node reached there, and which direction to try next from it
+            struct frame
+            {
+                node_type node;
+                int cell;
+                int step;
+            };
+
+            bool _iterative = false;
+            search_options _options;
+            std::vector<frame> _stack;
+
+            // The actual recursive function
+            void solve(node_type subdictionary, int next)
+            {
                 // Have we already visited the next space to build our word so far? If so, illegal path
-                if (std::find(path.begin(), path.end(), next) != path.end()) { return; }
+                if (_visited.contains(next)) { return; }
 
                 // If we add the next letter, are there any words in the dictionary that start with our sequence so far? If not, no need to keep searching this path
-                char_t next_element = board(next.first, next.second);
-                auto child_dictionary = subdictionary.subtrie(next_element);
-                if (!child_dictionary) { return; }
+                char_t next_element = _board->at(next);
+                auto child_dictionary = traits::child(_dictionary, subdictionary, next_element);
+                if (!traits::is_node(child_dictionary)) { return; }
 
                 // Add the next letter to our word so far
-                word.push_back(next_element);
-                path.push_back(next);
+                _word.push_back(next_element);
+                _visited.insert(next);
+                if (wants_path<TCollector>::value) { _path.push_back(next); }
 
                 // If the path so far is a valid word, add it to the found list
-                if (child_dictionary->contains_this())
+                if (traits::contains_word(_dictionary, child_dictionary))
                 {
-                    found.insert(word);
+                    report(child_dictionary, wants_path<TCollector>{});
                 }
 
-                // Try recursively adding to the path in the eight legal directions
-                solve(board, *child_dictionary, word, path, address{ next.first-1, next.second-1 }, found);
-                solve(board, *child_dictionary, word, path, address{ next.first-1, next.second }, found);
-                solve(board, *child_dictionary, word, path, address{ next.first-1, next.second+1 }, found);
-                solve(board, *child_dictionary, word, path, address{ next.first, next.second-1 }, found);
-                solve(board, *child_dictionary, word, path, address{ next.first, next.second+1 }, found);
-                solve(board, *child_dictionary, word, path, address{ next.first+1, next.second-1 }, found);
-                solve(board, *child_dictionary, word, path, address{ next.first+1, next.second }, found);
-                solve(board, *child_dictionary, word, path, address{ next.first+1, next.second+1 }, found);
+                // Try recursively adding to the path in the eight directions (any off the board are stopped by the visited check)
+                for (auto step : _steps)
+                {
+                    solve(child_dictionary, next + step);
+                }
 
                 // Put our working state back how we found it (would be nice to guarantee this with an RAII construct)
-                path.pop_back();
-                word.pop_back();
+                if (wants_path<TCollector>::value) { _path.pop_back(); }
+                _visited.erase(next);
+                _word.pop_back();
+            }
+
+            void report(node_type node, std::true_type) { _found(node, _word, _path); }
+            void report(node_type node, std::false_type) { _found(node, _word); }
+
+            // The same search, without recursion
+            void iterate(int start)
+            {
+                std::size_t depth = 0;
+                auto push = [&](node_type node, int cell)
+                {
+                    _word.push_back(_board->at(cell));
+                    _visited.insert(cell);
+                    if (wants_path<TCollector>::value) { _path.push_back(cell); }
+                    if (traits::contains_word(_dictionary, node) && _word.length() >= _options.min_length)
+                    {
+                        report(node, wants_path<TCollector>{});
+                    }
+
+                    // A path already at the maximum length won't go any further, so it starts out with no directions left to try
+                    _stack[depth] = frame{ node, cell, (depth + 1 == _stack.size()) ? static_cast<int>(_steps.size()) : 0 };
+                    ++depth;
+                };
+
+                if (_stack.empty() || _visited.contains(start)) { return; }
+                auto node = traits::child(_dictionary, traits::root(_dictionary), _board->at(start));
+                if (!traits::is_node(node)) { return; }
+                push(node, start);
+
+                while (depth > 0)
+                {
+                    auto& top = _stack[depth - 1];
+                    if (top.step == static_cast<int>(_steps.size()))
+                    {
+                        _visited.erase(top.cell);
+                        _word.pop_back();
+                        if (wants_path<TCollector>::value) { _path.pop_back(); }
+                        --depth;
+                        continue;
+                    }
+
+                    auto next = top.cell + _steps[top.step++];
+                    if (_visited.contains(next)) { continue; }
+                    auto child = traits::child(_dictionary, top.node, _board->at(next));
+                    if (!traits::is_node(child)) { continue; }
+                    push(child, next);
+                }
             }
         };
+    }
+
+    // Do a depth-first search among the space of all legal paths through the given Boggle board, with some very agressive trimming of the search tree
+    template<typename TChar, typename TDictionary>
+    std::set<std::basic_string<TChar>> solve(board<TChar> const& board, TDictionary const& dictionary)
+    {
+        detail::searcher<TChar, TDictionary> searcher{ dictionary };
+        searcher.reset(board);
 
         // Try starting paths from all locations on the board
-        for (int x = 0; x < board.width(); ++x)
+        searcher.search_rows(0, board.height());
+        return std::move(searcher.found().words());
+    }
+
+    // The same search, run on the explicit-stack engine, with limits on the length of the words found
+    template<typename TChar, typename TDictionary>
+    std::set<std::basic_string<TChar>> solve(board<TChar> const& board, TDictionary const& dictionary, search_options const& options)
+    {
+        detail::searcher<TChar, TDictionary> searcher{ dictionary };
+        searcher.limit(options);
+        searcher.reset(board);
+        searcher.search_rows(0, board.height());
+        return std::move(searcher.found().words());
+    }
+
+    // The same search, with the starting locations shared out among the given number of threads (counting the calling thread). Each thread searches with its own state, and the words found are merged at the end, so the result is exactly the same as solving on one thread.
+    template<typename TChar, typename TDictionary>
+    std::set<std::basic_string<TChar>> solve(board<TChar> const& board, TDictionary const& dictionary, unsigned thread_count)
+    {
+        if (thread_count <= 1) { return solve(board, dictionary); }
+
+        using searcher = detail::searcher<TChar, TDictionary>;
+        std::vector<searcher> searchers;
+        std::vector<std::exception_ptr> errors(thread_count);
+        for (unsigned i = 0; i < thread_count; ++i)
+        {
+            searchers.emplace_back(dictionary);
+            searchers.back().reset(board);
+        }
+
+        // Searches from some starting locations take far longer than others, so rather than divide the board up front, each thread keeps taking the next unclaimed row until there are none left
+        std::atomic<int> next_row{ 0 };
+        auto work = [&](unsigned i)
         {
-            for (int y = 0; y < board.height(); ++y)
+            try
             {
-                solver::solve(board, dictionary, word, path, address{ x, y }, found);
+                for (int y = next_row++; y < board.height(); y = next_row++)
+                {
+                    searchers[i].search_rows(y, y + 1);
+                }
             }
+            catch (...)
+            {
+                errors[i] = std::current_exception();
+                next_row = board.height();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        try
+        {
+            for (unsigned i = 1; i < thread_count; ++i) { threads.emplace_back(work, i); }
+        }
+        catch (...)
+        {
+            errors[0] = std::current_exception();
+            next_row = board.height();
         }
+        work(0);
+        for (auto& thread : threads) { thread.join(); }
+        for (auto const& error : errors)
+        {
+            if (error) { std::rethrow_exception(error); }
+        }
+
+        auto found = std::move(searchers[0].found().words());
+        for (unsigned i = 1; i < thread_count; ++i) { found.insert(searchers[i].found().words().begin(), searchers[i].found().words().end()); }
         return found;
     }
 }
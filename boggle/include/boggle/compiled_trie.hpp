@@ -0,0 +1,420 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "boggle/bits.hpp"
+#include "boggle/boggle.hpp"
+
+namespace boggle
+{
+    // A read-only trie, flattened into one contiguous array of small fixed-size nodes. The letters used by the dictionary are numbered densely (in sorted order), each node carries a 64-bit mask of which of those letters it has children for, and a node's children sit next to each other in the array in letter order. Finding a child is then a table lookup, a bit test and a popcount, rather than a tree search and a pointer chase.
+    //
+    // Since it's just a handful of flat arrays, a compiled trie can also be saved to a file and used straight from there, without loading or copying anything (see view(), and map_dictionary() in mapped_file.hpp). Copies share the same (immutable) storage.
+    template<typename TChar>
+    class compiled_trie
+    {
+    public:
+        using char_t = TChar;
+        using node_type = std::uint32_t;
+        using word_id = std::uint32_t;
+
+        static constexpr node_type no_node = std::numeric_limits<node_type>::max();
+        static constexpr word_id no_word = std::numeric_limits<word_id>::max();
+        static constexpr std::size_t max_alphabet_size = 64;
+
+        compiled_trie() { build({}); }
+
+        // Compile a dictionary from a list of words, in any order and possibly with repeats
+        template<typename TIter>
+        compiled_trie(TIter begin, TIter end)
+        {
+            std::vector<std::basic_string<char_t>> words;
+            for (auto i = begin; i != end; ++i)
+            {
+                words.emplace_back(std::begin(*i), std::end(*i));
+            }
+            std::sort(words.begin(), words.end());
+            words.erase(std::unique(words.begin(), words.end()), words.end());
+            build(words);
+        }
+
+        // Compile an existing trie
+        explicit compiled_trie(trie<char_t> const& source)
+        {
+            std::vector<std::basic_string<char_t>> words;
+            std::basic_string<char_t> word;
+            collect(source, word, words);
+            std::sort(words.begin(), words.end());
+            build(words);
+        }
+
+        node_type root() const { return 0; }
+
+        // Use a dictionary previously written by save(), straight from the memory it's in. The data is checked thoroughly enough that a corrupt or hostile file can't make lookups go out of bounds; if it's invalid, this throws std::runtime_error. The owner keeps the memory alive for as long as the trie (or any copy of it) exists; the data must be 8-byte aligned.
+        static compiled_trie view(void const* data, std::size_t size, std::shared_ptr<void const> owner)
+        {
+            compiled_trie result{ no_build{} };
+            result.attach(static_cast<unsigned char const*>(data), size);
+            result._storage = std::move(owner);
+            return result;
+        }
+
+        // Write the dictionary out in the form view() reads. The format is the in-memory layout, in native byte order, so it's only portable between machines of the same kind (which view() checks).
+        void save(std::ostream& s) const
+        {
+            file_header header{};
+            std::memcpy(header.magic, file_magic, sizeof(header.magic));
+            header.version = file_version;
+            header.byte_order = file_byte_order;
+            header.char_size = sizeof(char_t);
+            header.node_count = _node_count;
+            header.alphabet_size = _alphabet_size;
+            header.word_count = _word_count;
+            header.text_length = _word_offsets[_word_count];
+
+            auto write = [&s](void const* data, std::size_t size)
+            {
+                static char const padding[8] = {};
+                s.write(static_cast<char const*>(data), size);
+                s.write(padding, aligned(size) - size);
+            };
+            write(&header, sizeof(header));
+            write(_nodes, _node_count * sizeof(node));
+            write(_alphabet, _alphabet_size * sizeof(char_t));
+            if (_symbols) { write(_symbols, symbol_table_size); }
+            write(_word_offsets, (_word_count + 1) * sizeof(std::uint64_t));
+            write(_text, header.text_length * sizeof(char_t));
+            if (!s) { throw std::runtime_error("failed writing dictionary"); }
+        }
+
+        node_type child(node_type node, char_t c) const
+        {
+            assert(node < _node_count);
+            auto s = symbol(c);
+            if (s == no_symbol) { return no_node; }
+            auto const& n = _nodes[node];
+            auto bit = std::uint64_t{ 1 } << s;
+            if ((n.children & bit) == 0) { return no_node; }
+            return n.first_child + detail::popcount(n.children & (bit - 1));
+        }
+
+        // Visit each (letter, child node) pair directly below a node, in letter order. Children always have higher numbers than their parents.
+        template<typename TFunc>
+        void for_each_child(node_type node, TFunc&& f) const
+        {
+            assert(node < _node_count);
+            auto const& n = _nodes[node];
+            auto child = n.first_child;
+            for (auto bits = n.children; bits != 0; bits &= bits - 1)
+            {
+                f(_alphabet[detail::count_trailing_zeros(bits)], child++);
+            }
+        }
+
+        bool contains_word(node_type node) const { return word(node) != no_word; }
+
+        // Words are numbered densely, in sorted order
+        word_id word(node_type node) const
+        {
+            assert(node < _node_count);
+            return _nodes[node].word;
+        }
+
+        // Spell out a word, given its id
+        std::basic_string<char_t> spelling(word_id word) const
+        {
+            std::basic_string<char_t> s;
+            spell(word, s);
+            return s;
+        }
+
+        // Spell out a word into an existing string, reusing its storage
+        void spell(word_id word, std::basic_string<char_t>& s) const
+        {
+            assert(word < _word_count);
+            s.assign(_text + _word_offsets[word], _text + _word_offsets[word + 1]);
+        }
+
+        template<typename TIter>
+        bool contains_sequence(TIter const& begin, TIter const& end) const
+        {
+            auto node = root();
+            for (auto i = begin; i != end; ++i)
+            {
+                node = child(node, *i);
+                if (node == no_node) { return false; }
+            }
+            return contains_word(node);
+        }
+
+        template<typename TSeq>
+        bool contains_sequence(TSeq const& seq) const { return contains_sequence(std::begin(seq), std::end(seq)); }
+
+        std::size_t node_count() const { return _node_count; }
+        std::size_t word_count() const { return _word_count; }
+        std::size_t max_word_length() const { return _max_word_length; }
+        std::basic_string<char_t> alphabet() const { return std::basic_string<char_t>(_alphabet, _alphabet_size); }
+
+    private:
+        struct node
+        {
+            std::uint64_t children;
+            node_type first_child;
+            word_id word;
+        };
+        static_assert(sizeof(node) == 16, "nodes are saved to files as-is");
+
+        // A range of the sorted word list, all sharing the same prefix of the given length
+        struct span
+        {
+            std::size_t begin;
+            std::size_t end;
+            std::size_t depth;
+        };
+
+        // The arrays, when the trie is built in memory rather than viewed in a file
+        struct built_storage
+        {
+            std::vector<node> nodes;
+            std::basic_string<char_t> alphabet;
+            std::vector<std::uint8_t> symbols;
+            std::vector<std::uint64_t> word_offsets;
+            std::basic_string<char_t> text;
+        };
+
+        // The file starts with this, followed by each array in the order above, each padded to a multiple of 8 bytes
+        struct file_header
+        {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t byte_order;
+            std::uint64_t char_size;
+            std::uint64_t node_count;
+            std::uint64_t alphabet_size;
+            std::uint64_t word_count;
+            std::uint64_t text_length;
+        };
+
+        struct no_build {};
+
+        static constexpr std::uint8_t no_symbol = 0xFF;
+        static constexpr std::size_t symbol_table_size = 256;
+        static constexpr char file_magic[8] = { 'B', 'O', 'G', 'G', 'L', 'E', 'D', 'I' };
+        static constexpr std::uint32_t file_version = 1;
+        static constexpr std::uint32_t file_byte_order = 0x01020304;
+
+        // Everything lookups need, as plain arrays, pointing either into built_storage or straight into a file
+        node const* _nodes = nullptr;
+        std::size_t _node_count = 0;
+        char_t const* _alphabet = nullptr;
+        std::size_t _alphabet_size = 0;
+        std::uint8_t const* _symbols = nullptr; // only for byte-sized letters
+        std::size_t _word_count = 0;
+        std::size_t _max_word_length = 0;
+
+        // Every word, back to back in id order, for spelling words out again
+        char_t const* _text = nullptr;
+        std::uint64_t const* _word_offsets = nullptr;
+
+        // Whatever the arrays point into
+        std::shared_ptr<void const> _storage;
+
+        explicit compiled_trie(no_build) {}
+
+        static std::size_t aligned(std::size_t size) { return (size + 7) & ~std::size_t{ 7 }; }
+
+        // Point the arrays into a saved dictionary, checking everything they'll be trusted for later
+        void attach(unsigned char const* data, std::size_t size)
+        {
+            auto invalid = [](char const* what) { return std::runtime_error(std::string{ "invalid dictionary file: " } + what); };
+            if (reinterpret_cast<std::uintptr_t>(data) % 8 != 0) { throw invalid("misaligned"); }
+            if (size < sizeof(file_header)) { throw invalid("truncated"); }
+            file_header header;
+            std::memcpy(&header, data, sizeof(header));
+            if (std::memcmp(header.magic, file_magic, sizeof(header.magic)) != 0) { throw invalid("not a dictionary"); }
+            if (header.version != file_version) { throw invalid("unsupported version"); }
+            if (header.byte_order != file_byte_order) { throw invalid("wrong byte order"); }
+            if (header.char_size != sizeof(char_t)) { throw invalid("wrong character type"); }
+            if (header.node_count == 0 || header.node_count > no_node || header.alphabet_size > max_alphabet_size || header.word_count >= no_word) { throw invalid("bad header"); }
+
+            // The counts are bounded now, but the text length isn't, so work out the layout carefully
+            std::size_t offset = aligned(sizeof(file_header));
+            auto section = [&](std::uint64_t count, std::size_t element_size)
+            {
+                if (count > (size - offset) / element_size) { throw invalid("truncated"); }
+                auto start = data + offset;
+                offset += aligned(count * element_size);
+                if (offset > size) { throw invalid("truncated"); }
+                return start;
+            };
+            _node_count = header.node_count;
+            _nodes = reinterpret_cast<node const*>(section(_node_count, sizeof(node)));
+            _alphabet_size = header.alphabet_size;
+            _alphabet = reinterpret_cast<char_t const*>(section(_alphabet_size, sizeof(char_t)));
+            _symbols = (sizeof(char_t) == 1) ? section(symbol_table_size, 1) : nullptr;
+            _word_count = header.word_count;
+            _word_offsets = reinterpret_cast<std::uint64_t const*>(section(_word_count + 1, sizeof(std::uint64_t)));
+            _text = reinterpret_cast<char_t const*>(section(header.text_length, sizeof(char_t)));
+            if (offset != size) { throw invalid("wrong size"); }
+
+            for (std::size_t s = 1; s < _alphabet_size; ++s)
+            {
+                if (!std::char_traits<char_t>::lt(_alphabet[s - 1], _alphabet[s])) { throw invalid("bad alphabet"); }
+            }
+            if (_symbols)
+            {
+                for (std::size_t c = 0; c < symbol_table_size; ++c)
+                {
+                    auto s = _symbols[c];
+                    if (s != no_symbol && (s >= _alphabet_size || static_cast<typename std::make_unsigned<char_t>::type>(_alphabet[s]) != c)) { throw invalid("bad symbol table"); }
+                }
+            }
+            if (_word_offsets[0] != 0 || _word_offsets[_word_count] != header.text_length) { throw invalid("bad word offsets"); }
+            for (std::size_t w = 0; w < _word_count; ++w)
+            {
+                if (_word_offsets[w] > _word_offsets[w + 1]) { throw invalid("bad word offsets"); }
+                _max_word_length = std::max<std::size_t>(_max_word_length, _word_offsets[w + 1] - _word_offsets[w]);
+            }
+
+            // Children always come after their parent, so every walk down the trie ends
+            auto alphabet_mask = (_alphabet_size == 64) ? ~std::uint64_t{ 0 } : (std::uint64_t{ 1 } << _alphabet_size) - 1;
+            for (std::size_t n = 0; n < _node_count; ++n)
+            {
+                auto const& current = _nodes[n];
+                if ((current.children & ~alphabet_mask) != 0) { throw invalid("bad node"); }
+                if (current.word != no_word && current.word >= _word_count) { throw invalid("bad node"); }
+                if (current.children != 0 && (current.first_child <= n || current.first_child > _node_count - detail::popcount(current.children))) { throw invalid("bad node"); }
+            }
+        }
+
+        static void collect(trie<char_t> const& source, std::basic_string<char_t>& word, std::vector<std::basic_string<char_t>>& words)
+        {
+            if (source.contains_this()) { words.push_back(word); }
+            source.for_each_child([&](char_t c, trie<char_t> const& child)
+            {
+                word.push_back(c);
+                collect(child, word, words);
+                word.pop_back();
+            });
+        }
+
+        // Map a letter to its dense index in the alphabet (a straight table lookup for byte-sized letters)
+        std::uint8_t symbol(char_t c) const
+        {
+            using uchar_t = typename std::make_unsigned<char_t>::type;
+            if (_symbols) { return _symbols[static_cast<uchar_t>(c)]; }
+            auto end = _alphabet + _alphabet_size;
+            auto i = std::lower_bound(_alphabet, end, c, [](char_t a, char_t b) { return std::char_traits<char_t>::lt(a, b); });
+            if (i == end || *i != c) { return no_symbol; }
+            return static_cast<std::uint8_t>(i - _alphabet);
+        }
+
+        // Lay the nodes out breadth-first, so that each node's children are allocated together, directly from the sorted, unique word list
+        void build(std::vector<std::basic_string<char_t>> const& words)
+        {
+            auto storage = std::make_shared<built_storage>();
+            for (auto const& w : words)
+            {
+                storage->word_offsets.push_back(storage->text.length());
+                storage->text.append(w);
+                _max_word_length = std::max(_max_word_length, w.length());
+            }
+            storage->word_offsets.push_back(storage->text.length());
+            auto& alphabet = storage->alphabet;
+            alphabet = storage->text;
+            std::sort(alphabet.begin(), alphabet.end(), [](char_t a, char_t b) { return std::char_traits<char_t>::lt(a, b); });
+            alphabet.erase(std::unique(alphabet.begin(), alphabet.end()), alphabet.end());
+            if (alphabet.size() > max_alphabet_size) { throw std::length_error("dictionary alphabet too large"); }
+            if (words.size() >= no_word) { throw std::length_error("dictionary too large"); }
+
+            _alphabet = alphabet.data();
+            _alphabet_size = alphabet.size();
+            if (sizeof(char_t) == 1)
+            {
+                storage->symbols.assign(symbol_table_size, no_symbol);
+                for (std::size_t s = 0; s < alphabet.size(); ++s)
+                {
+                    storage->symbols[static_cast<typename std::make_unsigned<char_t>::type>(alphabet[s])] = static_cast<std::uint8_t>(s);
+                }
+                _symbols = storage->symbols.data();
+            }
+
+            auto& nodes = storage->nodes;
+            std::vector<span> spans{ span{ 0, words.size(), 0 } };
+            nodes.push_back(node{ 0, no_node, no_word });
+            for (std::size_t n = 0; n < spans.size(); ++n)
+            {
+                auto current = spans[n];
+
+                // Sorting puts the word that is exactly this prefix (if any) first in the range
+                if (current.begin != current.end && words[current.begin].length() == current.depth)
+                {
+                    nodes[n].word = static_cast<word_id>(current.begin);
+                    ++current.begin;
+                }
+
+                if (nodes.size() >= no_node) { throw std::length_error("dictionary too large"); }
+                nodes[n].first_child = static_cast<node_type>(nodes.size());
+                for (auto i = current.begin; i != current.end;)
+                {
+                    auto c = words[i][current.depth];
+                    auto j = i;
+                    while (j != current.end && words[j][current.depth] == c) { ++j; }
+                    nodes[n].children |= std::uint64_t{ 1 } << symbol(c);
+                    nodes.push_back(node{ 0, no_node, no_word });
+                    spans.push_back(span{ i, j, current.depth + 1 });
+                    i = j;
+                }
+            }
+            nodes.shrink_to_fit();
+
+            _nodes = nodes.data();
+            _node_count = nodes.size();
+            _word_count = words.size();
+            _word_offsets = storage->word_offsets.data();
+            _text = storage->text.data();
+            _storage = std::move(storage);
+        }
+    };
+
+    template<typename TChar>
+    constexpr typename compiled_trie<TChar>::node_type compiled_trie<TChar>::no_node;
+
+    template<typename TChar>
+    constexpr typename compiled_trie<TChar>::word_id compiled_trie<TChar>::no_word;
+
+    template<typename TChar>
+    constexpr std::uint8_t compiled_trie<TChar>::no_symbol;
+
+    template<typename TChar>
+    constexpr std::size_t compiled_trie<TChar>::symbol_table_size;
+
+    template<typename TChar>
+    constexpr char compiled_trie<TChar>::file_magic[8];
+
+    template<typename TChar>
+    struct dictionary_traits<compiled_trie<TChar>>
+    {
+        using char_t = TChar;
+        using node_type = typename compiled_trie<TChar>::node_type;
+        using word_id = typename compiled_trie<TChar>::word_id;
+
+        static node_type root(compiled_trie<TChar> const& dictionary) { return dictionary.root(); }
+        static node_type child(compiled_trie<TChar> const& dictionary, node_type node, char_t c) { return dictionary.child(node, c); }
+        static bool contains_word(compiled_trie<TChar> const& dictionary, node_type node) { return dictionary.contains_word(node); }
+        static bool is_node(node_type node) { return node != compiled_trie<TChar>::no_node; }
+
+        // Unlike a trie, every word has a dense numeric id, which lets the word sets found be kept without allocating
+        static word_id word(compiled_trie<TChar> const& dictionary, node_type node) { return dictionary.word(node); }
+        static std::size_t word_count(compiled_trie<TChar> const& dictionary) { return dictionary.word_count(); }
+    };
+}
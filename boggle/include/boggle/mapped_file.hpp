@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#if defined(_WIN32)
+#include <fstream>
+#include <iterator>
+#include <vector>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "boggle/compiled_trie.hpp"
+
+namespace boggle
+{
+    // A read-only view of a whole file. On POSIX systems the file is memory-mapped, so nothing is read until it's used, and processes mapping the same file share the same physical pages. Elsewhere, the file is simply read into memory.
+    class mapped_file
+    {
+    public:
+        explicit mapped_file(std::string const& path)
+        {
+#if defined(_WIN32)
+            std::ifstream s{ path, std::ios::binary };
+            if (!s) { throw std::runtime_error("can't open " + path); }
+            s.seekg(0, std::ios::end);
+            auto size = static_cast<std::size_t>(s.tellg());
+            s.seekg(0, std::ios::beg);
+            _buffer.resize((size + 7) / 8);
+            s.read(reinterpret_cast<char*>(_buffer.data()), size);
+            _size = static_cast<std::size_t>(s.gcount());
+            _data = _buffer.data();
+#else
+            auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) { throw std::system_error(errno, std::generic_category(), "can't open " + path); }
+            struct stat st;
+            if (::fstat(fd, &st) != 0)
+            {
+                auto error = errno;
+                ::close(fd);
+                throw std::system_error(error, std::generic_category(), "can't stat " + path);
+            }
+            _size = static_cast<std::size_t>(st.st_size);
+            if (_size != 0)
+            {
+                _data = ::mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+                if (_data == MAP_FAILED)
+                {
+                    auto error = errno;
+                    ::close(fd);
+                    throw std::system_error(error, std::generic_category(), "can't map " + path);
+                }
+            }
+            ::close(fd);
+#endif
+        }
+
+        mapped_file(mapped_file const&) = delete;
+        mapped_file& operator=(mapped_file const&) = delete;
+
+        ~mapped_file()
+        {
+#if !defined(_WIN32)
+            if (_size != 0) { ::munmap(const_cast<void*>(_data), _size); }
+#endif
+        }
+
+        void const* data() const { return _data; }
+        std::size_t size() const { return _size; }
+
+    private:
+        void const* _data = nullptr;
+        std::size_t _size = 0;
+#if defined(_WIN32)
+        std::vector<std::uint64_t> _buffer;
+#endif
+    };
+
+    // Use a dictionary file written by compiled_trie::save() (or the boggle-compile-dictionary tool) in place, without loading it
+    template<typename TChar>
+    compiled_trie<TChar> map_dictionary(std::string const& path)
+    {
+        auto file = std::make_shared<mapped_file const>(path);
+        return compiled_trie<TChar>::view(file->data(), file->size(), file);
+    }
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "boggle/boggle.hpp"
+#include "boggle/compiled_trie.hpp"
+
+namespace boggle
+{
+    // How words score: points for the word's length, plus points for each of its letters
+    template<typename TChar>
+    struct score_table
+    {
+        // lengths[n] is the score for an n-letter word, and the last entry is the score for any longer word. The default is the standard Boggle table (nothing under three letters).
+        std::vector<std::uint32_t> lengths{ 0, 0, 0, 1, 1, 2, 3, 5, 11 };
+
+        // Extra points for particular letters (any not listed score nothing extra)
+        std::map<TChar, std::uint32_t> letters;
+
+        std::uint32_t score(std::basic_string<TChar> const& word) const
+        {
+            std::uint32_t total = lengths.empty() ? 0 : lengths[std::min(word.length(), lengths.size() - 1)];
+            if (!letters.empty())
+            {
+                for (auto c : word)
+                {
+                    auto i = letters.find(c);
+                    if (i != letters.end()) { total += i->second; }
+                }
+            }
+            return total;
+        }
+    };
+
+    // A compiled dictionary, with a score worked out ahead of time for every word, and for every node, the best score of any word at or below it: the most that following a path any further could be worth. The compiled trie must outlive this.
+    template<typename TChar>
+    class scored_dictionary
+    {
+    public:
+        using char_t = TChar;
+        using dictionary_type = compiled_trie<char_t>;
+        using node_type = typename dictionary_type::node_type;
+        using word_id = typename dictionary_type::word_id;
+
+        explicit scored_dictionary(dictionary_type const& dictionary, score_table<char_t> const& scores = {}) : _dictionary{ dictionary }, _scores(dictionary.word_count()), _best(dictionary.node_count(), 0)
+        {
+            std::basic_string<char_t> spelling;
+            for (word_id w = 0; w < _scores.size(); ++w)
+            {
+                dictionary.spell(w, spelling);
+                _scores[w] = scores.score(spelling);
+            }
+
+            // Children always come after their parents, so going backwards, every node's children are done before it is
+            for (auto n = static_cast<node_type>(_best.size()); n-- > 0;)
+            {
+                auto best = dictionary.contains_word(n) ? _scores[dictionary.word(n)] : 0;
+                dictionary.for_each_child(n, [&](char_t, node_type child) { best = std::max(best, _best[child]); });
+                _best[n] = best;
+            }
+        }
+
+        dictionary_type const& dictionary() const { return _dictionary; }
+        std::uint32_t score(word_id word) const { return _scores[word]; }
+        std::uint32_t best_score(node_type node) const { return _best[node]; }
+
+    private:
+        dictionary_type const& _dictionary;
+        std::vector<std::uint32_t> _scores;
+        std::vector<std::uint32_t> _best;
+    };
+
+    // A word found on a board, with its score, and the cells spelling it out, from the first letter to the last
+    template<typename TChar>
+    struct scored_word
+    {
+        struct position
+        {
+            int x;
+            int y;
+        };
+
+        typename compiled_trie<TChar>::word_id id;
+        std::basic_string<TChar> word;
+        std::uint32_t score;
+        std::vector<position> path;
+    };
+
+    namespace detail
+    {
+        // The dictionary a top-K search walks: a scored dictionary, seen through a threshold that rises as better words are found. A node whose best score is below the threshold looks like no node at all, so the search cuts off every path that can't lead to a word good enough to keep.
+        template<typename TChar>
+        struct top_k_view
+        {
+            using char_t = TChar;
+
+            scored_dictionary<TChar> const& scores;
+            std::uint32_t threshold;
+        };
+
+        // Keeps the best k words found so far (each word once, however many paths spell it, with the first path it was found along) in a heap with the worst of them on top, raising the view's threshold to that word's score once there are k
+        template<typename TChar>
+        class top_k_collector
+        {
+        public:
+            using word_id = typename compiled_trie<TChar>::word_id;
+
+            struct entry
+            {
+                std::uint32_t score;
+                word_id id;
+                std::vector<int> cells;
+            };
+
+            static constexpr bool wants_path = true;
+
+            top_k_collector(top_k_view<TChar>& view, std::size_t k) : _view{ view }, _k{ k }, _kept(view.scores.dictionary().word_count(), false) {}
+
+            template<typename TWord>
+            void operator()(typename compiled_trie<TChar>::node_type node, TWord const&, std::vector<int> const& path)
+            {
+                auto id = _view.scores.dictionary().word(node);
+                if (_kept[id]) { return; }
+                entry e{ _view.scores.score(id), id, {} };
+                if (e.score < _view.threshold) { return; }
+                if (_heap.size() == _k)
+                {
+                    if (!better(e, _heap.front())) { return; }
+                    std::pop_heap(_heap.begin(), _heap.end(), better);
+                    // The entry going out gives up its cells for the one coming in, so a full heap doesn't allocate again
+                    e.cells = std::move(_heap.back().cells);
+                    _heap.pop_back();
+                }
+                e.cells.assign(path.begin(), path.end());
+                _heap.push_back(std::move(e));
+                std::push_heap(_heap.begin(), _heap.end(), better);
+                _kept[id] = true;
+                if (_heap.size() == _k) { _view.threshold = std::max(_view.threshold, _heap.front().score); }
+            }
+
+            // Best first (and, among equal scores, in dictionary order)
+            std::vector<entry> sorted()
+            {
+                std::sort_heap(_heap.begin(), _heap.end(), better);
+                return std::move(_heap);
+            }
+
+            static bool better(entry const& a, entry const& b) { return a.score > b.score || (a.score == b.score && a.id < b.id); }
+
+        private:
+            top_k_view<TChar>& _view;
+            std::size_t _k;
+            std::vector<bool> _kept;
+            std::vector<entry> _heap;
+        };
+    }
+
+    template<typename TChar>
+    struct dictionary_traits<detail::top_k_view<TChar>>
+    {
+        using char_t = TChar;
+        using node_type = typename compiled_trie<TChar>::node_type;
+
+        static node_type root(detail::top_k_view<TChar> const& view) { return view.scores.dictionary().root(); }
+
+        static node_type child(detail::top_k_view<TChar> const& view, node_type node, char_t c)
+        {
+            auto child = view.scores.dictionary().child(node, c);
+            return (child != compiled_trie<TChar>::no_node && view.scores.best_score(child) >= view.threshold) ? child : compiled_trie<TChar>::no_node;
+        }
+
+        static bool contains_word(detail::top_k_view<TChar> const& view, node_type node) { return view.scores.dictionary().contains_word(node); }
+        static bool is_node(node_type node) { return node != compiled_trie<TChar>::no_node; }
+    };
+
+    // Find the k highest-scoring words on a board (or all of them, if there are fewer), best first, with the path spelling each one out. Words which score nothing aren't reported. Among words with the same score, those earlier in the dictionary win, so the result is exactly the first k of all the words found, sorted by score.
+    //
+    // The search keeps the best k words so far, and once it has k, only follows paths which could still lead to a word scoring at least as well as the worst of them. With a small k, that cuts off most of the search.
+    template<typename TChar>
+    std::vector<scored_word<TChar>> solve_top(board<TChar> const& board, scored_dictionary<TChar> const& dictionary, std::size_t k)
+    {
+        std::vector<scored_word<TChar>> results;
+        if (k == 0) { return results; }
+
+        detail::top_k_view<TChar> view{ dictionary, 1 };
+        detail::searcher<TChar, detail::top_k_view<TChar>, detail::top_k_collector<TChar>> searcher{ view, view, k };
+        searcher.reset(board);
+        searcher.search_rows(0, board.height());
+
+        for (auto const& e : searcher.found().sorted())
+        {
+            scored_word<TChar> result{ e.id, dictionary.dictionary().spelling(e.id), e.score, {} };
+            for (auto cell : e.cells)
+            {
+                result.path.push_back(typename scored_word<TChar>::position{ cell % board.stride() - 1, cell / board.stride() - 1 });
+            }
+            results.push_back(std::move(result));
+        }
+        return results;
+    }
+}
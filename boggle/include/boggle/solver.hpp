@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "boggle/boggle.hpp"
+#include "boggle/word_set.hpp"
+
+namespace boggle
+{
+    namespace detail
+    {
+        // Collects the ids of the words found on one board into a list, once each. Each id is stamped with the number of the board it was last seen on, so telling a repeat from a new word is a single comparison, and nothing needs clearing between boards.
+        template<typename TDictionary>
+        class word_id_collector
+        {
+        public:
+            using traits = dictionary_traits<TDictionary>;
+            using word_id = typename traits::word_id;
+
+            explicit word_id_collector(TDictionary const& dictionary) : _dictionary{ dictionary }, _seen(traits::word_count(dictionary), 0) {}
+
+            // Start collecting the words for a new board into the given list
+            void reset(std::vector<word_id>& words)
+            {
+                if (++_board == 0)
+                {
+                    std::fill(_seen.begin(), _seen.end(), 0);
+                    _board = 1;
+                }
+                _words = &words;
+                _words->clear();
+            }
+
+            template<typename TWord>
+            void operator()(typename traits::node_type node, TWord const&)
+            {
+                auto id = traits::word(_dictionary, node);
+                if (_seen[id] == _board) { return; }
+                _seen[id] = _board;
+                _words->push_back(id);
+            }
+
+        private:
+            TDictionary const& _dictionary;
+            std::vector<std::uint32_t> _seen;
+            std::uint32_t _board = 0;
+            std::vector<word_id>* _words = nullptr;
+        };
+    }
+
+    // Solves many boards against one dictionary. The solver keeps its working state (one per worker thread) between boards, so once it has warmed up, solving doesn't allocate at all. The words found on each board come back as a list of dictionary word ids, in sorted order, so it also doesn't allocate per word found. The dictionary needs dense word ids for this (compiled_trie has them), and must outlive the solver.
+    template<typename TDictionary>
+    class solver
+    {
+    public:
+        using traits = dictionary_traits<TDictionary>;
+        using char_t = typename traits::char_t;
+        using word_id = typename traits::word_id;
+        using result = std::vector<word_id>;
+
+        explicit solver(TDictionary const& dictionary, unsigned thread_count = 1) : _dictionary{ dictionary }
+        {
+            for (unsigned i = 0; i < std::max(thread_count, 1u); ++i)
+            {
+                _workers.push_back(std::make_unique<worker>(dictionary));
+            }
+        }
+
+        TDictionary const& dictionary() const { return _dictionary; }
+        unsigned thread_count() const { return static_cast<unsigned>(_workers.size()); }
+
+        // Solve one board, on the calling thread
+        void solve(board<char_t> const& board, result& found) { _workers.front()->solve(board, found); }
+
+        // Solve one board, on the calling thread, adding the words found to the given set
+        void solve(board<char_t> const& board, word_set<TDictionary>& found) { _workers.front()->solve(board, found); }
+
+        result solve(board<char_t> const& board)
+        {
+            result found;
+            solve(board, found);
+            return found;
+        }
+
+        // Solve a batch of boards, shared out among the solver's threads (counting the calling thread), writing the words found on each board to the corresponding element of the results range. Reusing the same result lists from batch to batch means they don't need to allocate either.
+        template<typename TBoardIter, typename TResultIter>
+        void solve(TBoardIter boards_begin, TBoardIter boards_end, TResultIter results)
+        {
+            auto count = static_cast<std::size_t>(std::distance(boards_begin, boards_end));
+            std::vector<std::exception_ptr> errors(_workers.size());
+
+            // Each thread keeps taking the next unclaimed board until there are none left
+            std::atomic<std::size_t> next_board{ 0 };
+            auto work = [&](std::size_t i)
+            {
+                try
+                {
+                    for (auto b = next_board++; b < count; b = next_board++)
+                    {
+                        _workers[i]->solve(boards_begin[b], results[b]);
+                    }
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                    next_board = count;
+                }
+            };
+
+            std::vector<std::thread> threads;
+            try
+            {
+                for (std::size_t i = 1; i < std::min<std::size_t>(_workers.size(), count); ++i) { threads.emplace_back(work, i); }
+            }
+            catch (...)
+            {
+                errors[0] = std::current_exception();
+                next_board = count;
+            }
+            work(0);
+            for (auto& thread : threads) { thread.join(); }
+            for (auto const& error : errors)
+            {
+                if (error) { std::rethrow_exception(error); }
+            }
+        }
+
+        template<typename TBoards>
+        std::vector<result> solve_all(TBoards const& boards)
+        {
+            std::vector<result> results(std::distance(std::begin(boards), std::end(boards)));
+            solve(std::begin(boards), std::end(boards), results.begin());
+            return results;
+        }
+
+    private:
+        using collector = detail::word_id_collector<TDictionary>;
+
+        // The working state for one thread
+        class worker
+        {
+        public:
+            explicit worker(TDictionary const& dictionary) : _searcher{ dictionary, dictionary }, _set_searcher{ dictionary } {}
+
+            void solve(board<char_t> const& board, result& found)
+            {
+                _searcher.reset(board);
+                _searcher.found().reset(found);
+                _searcher.search_rows(0, board.height());
+                std::sort(found.begin(), found.end());
+            }
+
+            void solve(board<char_t> const& board, word_set<TDictionary>& found)
+            {
+                _set_searcher.reset(board);
+                _set_searcher.found().reset(found);
+                _set_searcher.search_rows(0, board.height());
+            }
+
+        private:
+            detail::searcher<char_t, TDictionary, collector> _searcher;
+            detail::searcher<char_t, TDictionary, detail::word_set_collector<TDictionary>> _set_searcher;
+        };
+
+        TDictionary const& _dictionary;
+        std::vector<std::unique_ptr<worker>> _workers;
+    };
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "boggle/boggle.hpp"
+#include "boggle/compiled_trie.hpp"
+
+namespace boggle
+{
+    namespace detail
+    {
+        // Passes each distinct word found on to a callback, the first time it's found
+        template<typename TDictionary, typename TFunc>
+        class callback_collector
+        {
+        public:
+            using node_type = typename dictionary_traits<TDictionary>::node_type;
+
+            explicit callback_collector(TFunc& f) : _f{ f } {}
+
+            template<typename TWord>
+            void operator()(node_type node, TWord const& word)
+            {
+                if (_seen.insert(node).second) { _f(word); }
+            }
+
+        private:
+            TFunc& _f;
+            std::set<node_type> _seen;
+        };
+    }
+
+    // Solve a board read from a stream (in the same format as operator>> reads), without ever holding the whole board. A path spelling a word of at most max_word_length letters can't reach more than max_word_length - 1 rows above or below where it starts, so only that many rows either side of the rows being searched need to be kept. Rows are searched a block at a time, as soon as enough rows below them have been read, and each distinct word is passed to the callback as soon as it's found. Words longer than max_word_length aren't looked for. Memory use depends on the board's width and the dictionary, but not on the board's height.
+    template<typename TChar, typename TDictionary, typename TFunc>
+    void solve_stream(std::basic_istream<TChar>& s, TDictionary const& dictionary, std::size_t max_word_length, TFunc&& on_word)
+    {
+        using char_t = TChar;
+        using collector = detail::callback_collector<TDictionary, typename std::remove_reference<TFunc>::type>;
+
+        auto reach = static_cast<int>(std::max<std::size_t>(max_word_length, 1)) - 1;
+        auto block = reach + 1;
+
+        // The rows read so far and not yet discarded, and the (absolute) number of the first
+        std::deque<std::basic_string<char_t>> rows;
+        int first_row = 0;
+        int width = 0;
+        bool more = true;
+
+        board<char_t> window;
+        detail::searcher<char_t, TDictionary, collector> searcher{ dictionary, on_word };
+
+        // Without the limit, a longer word near the edge of the window would be found or not depending on where the blocks happened to fall
+        search_options options;
+        options.max_length = max_word_length;
+        searcher.limit(options);
+
+        for (int next_row = 0; true; next_row += block)
+        {
+            // Read far enough ahead that every path from the next block of rows stays within what's been read
+            while (more && first_row + static_cast<int>(rows.size()) < next_row + block + reach)
+            {
+                std::basic_string<char_t> line;
+                std::getline(s, line);
+                if (line.length() == 0)
+                {
+                    more = false;
+                    break;
+                }
+                if (width == 0)
+                {
+                    width = static_cast<int>(line.length());
+                }
+                else if (width != static_cast<int>(line.length()))
+                {
+                    throw std::runtime_error("nonrectangular input");
+                }
+                rows.push_back(std::move(line));
+            }
+
+            auto end_row = first_row + static_cast<int>(rows.size());
+            if (next_row >= end_row) { break; }
+
+            window = board<char_t>{ width, static_cast<int>(rows.size()) };
+            for (int y = 0; y < window.height(); ++y)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    window(x, y) = rows[y][x];
+                }
+            }
+            searcher.reset(window);
+            auto last_row = std::min(next_row + block, end_row);
+            searcher.search_rows(next_row - first_row, last_row - first_row);
+
+            // Keep only the rows which paths from the next block could reach
+            while (first_row < last_row - reach)
+            {
+                rows.pop_front();
+                ++first_row;
+            }
+        }
+    }
+
+    // The same, using the compiled dictionary's own longest word
+    template<typename TChar, typename TFunc>
+    void solve_stream(std::basic_istream<TChar>& s, compiled_trie<TChar> const& dictionary, TFunc&& on_word)
+    {
+        solve_stream(s, dictionary, dictionary.max_word_length(), std::forward<TFunc>(on_word));
+    }
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "boggle/bits.hpp"
+#include "boggle/boggle.hpp"
+
+namespace boggle
+{
+    // A set of words from one dictionary, kept as one bit per dictionary word id. Adding a word (or finding it's already there) is a single bit operation, and nothing is allocated after construction, so this is a cheap way to collect the words found on a board. The words are only spelled out when they're asked for, and come out in sorted order. The dictionary needs dense word ids (compiled_trie has them), and must outlive the set.
+    template<typename TDictionary>
+    class word_set
+    {
+    public:
+        using traits = dictionary_traits<TDictionary>;
+        using char_t = typename traits::char_t;
+        using word_id = typename traits::word_id;
+
+        // Iterates the ids of the words in the set, in increasing order
+        class const_iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = word_id;
+            using difference_type = std::ptrdiff_t;
+            using pointer = word_id const*;
+            using reference = word_id;
+
+            const_iterator() = default;
+
+            word_id operator*() const { return static_cast<word_id>(_block * 64 + detail::count_trailing_zeros(_bits)); }
+
+            const_iterator& operator++()
+            {
+                _bits &= _bits - 1;
+                skip_empty();
+                return *this;
+            }
+
+            const_iterator operator++(int)
+            {
+                auto i = *this;
+                ++*this;
+                return i;
+            }
+
+            bool operator==(const_iterator const& other) const { return _block == other._block && _bits == other._bits; }
+            bool operator!=(const_iterator const& other) const { return !(*this == other); }
+
+        private:
+            friend class word_set;
+
+            std::vector<std::uint64_t> const* _blocks = nullptr;
+            std::size_t _block = 0;
+            std::uint64_t _bits = 0;
+
+            const_iterator(std::vector<std::uint64_t> const& blocks, std::size_t block) : _blocks{ &blocks }, _block{ block }, _bits{ block < blocks.size() ? blocks[block] : 0 } { skip_empty(); }
+
+            void skip_empty()
+            {
+                while (_bits == 0 && _block < _blocks->size())
+                {
+                    ++_block;
+                    _bits = (_block < _blocks->size()) ? (*_blocks)[_block] : 0;
+                }
+            }
+        };
+
+        explicit word_set(TDictionary const& dictionary) : _dictionary{ dictionary }, _blocks((traits::word_count(dictionary) + 63) / 64) {}
+
+        TDictionary const& dictionary() const { return _dictionary; }
+
+        // Add a word, returning whether it was new
+        bool insert(word_id word)
+        {
+            auto& block = _blocks[word / 64];
+            auto bit = std::uint64_t{ 1 } << (word % 64);
+            if (block & bit) { return false; }
+            block |= bit;
+            ++_size;
+            return true;
+        }
+
+        bool contains(word_id word) const { return (_blocks[word / 64] & (std::uint64_t{ 1 } << (word % 64))) != 0; }
+
+        std::size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+
+        void clear()
+        {
+            std::fill(_blocks.begin(), _blocks.end(), 0);
+            _size = 0;
+        }
+
+        const_iterator begin() const { return const_iterator{ _blocks, 0 }; }
+        const_iterator end() const { return const_iterator{ _blocks, _blocks.size() }; }
+
+        // Visit each word in the set, in sorted order, spelled out into one string buffer that's reused from word to word
+        template<typename TFunc>
+        void for_each_word(TFunc&& f) const
+        {
+            std::basic_string<char_t> spelling;
+            for (auto id : *this)
+            {
+                _dictionary.spell(id, spelling);
+                f(static_cast<std::basic_string<char_t> const&>(spelling));
+            }
+        }
+
+        // Spell out every word in the set, in the same form solve() returns them
+        std::set<std::basic_string<char_t>> strings() const
+        {
+            std::set<std::basic_string<char_t>> words;
+            for_each_word([&words](std::basic_string<char_t> const& word) { words.insert(words.end(), word); });
+            return words;
+        }
+
+    private:
+        TDictionary const& _dictionary;
+        std::vector<std::uint64_t> _blocks;
+        std::size_t _size = 0;
+    };
+
+    namespace detail
+    {
+        // Adds the ids of the words found to a word_set
+        template<typename TDictionary>
+        class word_set_collector
+        {
+        public:
+            using traits = dictionary_traits<TDictionary>;
+
+            explicit word_set_collector(word_set<TDictionary>* words = nullptr) : _words{ words } {}
+
+            void reset(word_set<TDictionary>& words) { _words = &words; }
+
+            template<typename TWord>
+            void operator()(typename traits::node_type node, TWord const&) { _words->insert(traits::word(_words->dictionary(), node)); }
+
+        private:
+            word_set<TDictionary>* _words;
+        };
+    }
+
+    // Solve a board, adding the words found to the given set (which isn't cleared first)
+    template<typename TChar, typename TDictionary>
+    void solve(board<TChar> const& board, TDictionary const& dictionary, word_set<TDictionary>& found)
+    {
+        detail::searcher<TChar, TDictionary, detail::word_set_collector<TDictionary>> searcher{ dictionary, &found };
+        searcher.reset(board);
+        searcher.search_rows(0, board.height());
+    }
+}
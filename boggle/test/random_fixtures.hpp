@@ -0,0 +1,42 @@
+#pragma once
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "boggle/boggle.hpp"
+
+// Random boards and word lists, shared by the tests and the benchmarks (so that both see the same inputs for the same seeds)
+
+inline boggle::board<char> make_random_board(int width, int height, unsigned seed)
+{
+    std::default_random_engine random{ seed };
+    std::uniform_int_distribution<char> letters{ 'a', 'z' };
+    boggle::board<char> board{ width, height };
+    for (auto x = 0; x < board.width(); ++x)
+    {
+        for (auto y = 0; y < board.height(); ++y)
+        {
+            board(x, y) = letters(random);
+        }
+    }
+    return board;
+}
+
+inline std::vector<std::string> make_random_words(int count, unsigned seed)
+{
+    std::default_random_engine random{ seed };
+    std::uniform_int_distribution<char> letters{ 'a', 'z' };
+    std::uniform_int_distribution<int> lengths{ 3, 7 };
+    std::vector<std::string> words;
+    for (int i = 0; i < count; ++i)
+    {
+        std::string word;
+        for (int size = lengths(random); size > 0; --size)
+        {
+            word.push_back(letters(random));
+        }
+        words.push_back(word);
+    }
+    return words;
+}
@@ -1,8 +1,22 @@
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <gtest/gtest.h>
 #include <random>
+#include <sstream>
 
 #include "boggle/boggle.hpp"
+#include "boggle/compiled_trie.hpp"
+#include "boggle/mapped_file.hpp"
+#include "boggle/scoring.hpp"
+#include "boggle/solver.hpp"
+#include "boggle/stream.hpp"
+#include "boggle/word_set.hpp"
+
+#include "random_fixtures.hpp"
 
 using namespace std::chrono_literals;
 
@@ -48,9 +62,10 @@ TEST(Boggle, SmallKnownBoard)
     }
 }
 
+// A smoke test for gross performance regressions only; boggle-bench tracks the same workload (BM_SolveTrie/50/2500) properly
 TEST(Boggle, LargeRandomPerformance)
 {
-    std::default_random_engine random{ std::random_device{}() };
+    std::default_random_engine random{ 20180101 };
     std::uniform_int_distribution<char> letters{ 'a', 'z' };
 
     boggle::board<char> board{ 50, 50 };
@@ -89,3 +104,329 @@ TEST(Boggle, LargeRandomPerformance)
     auto end_time = std::chrono::high_resolution_clock::now();
     ASSERT_LE(end_time - begin_time, 1000ms);
 }
+
+TEST(Boggle, CompiledTrieContainsSequence)
+{
+    std::vector<std::string> words{ "blow", "blower", "brew", "fern", "few", "hen", "her", "her", "lower", "then" };
+    boggle::trie<char> source;
+    for (auto const& s : words) { source.insert_sequence(s); }
+
+    for (auto const& dictionary : { boggle::compiled_trie<char>{ words.begin(), words.end() }, boggle::compiled_trie<char>{ source } })
+    {
+        ASSERT_EQ(dictionary.word_count(), 9u);
+        for (auto const& s : words)
+        {
+            ASSERT_TRUE(dictionary.contains_sequence(s));
+        }
+        ASSERT_FALSE(dictionary.contains_sequence(std::string{ "blo" }));
+        ASSERT_FALSE(dictionary.contains_sequence(std::string{ "blowers" }));
+        ASSERT_FALSE(dictionary.contains_sequence(std::string{ "zebra" }));
+        ASSERT_FALSE(dictionary.contains_sequence(std::string{}));
+        ASSERT_EQ(dictionary.word(dictionary.child(dictionary.child(dictionary.child(dictionary.root(), 'f'), 'e'), 'w')), 4u);
+    }
+
+    std::vector<std::string> too_many_letters{ "abcdefghijklmnopqrstuvwxyz", "ABCDEFGHIJKLMNOPQRSTUVWXYZ", "0123456789!?-" };
+    ASSERT_THROW((boggle::compiled_trie<char>(too_many_letters.begin(), too_many_letters.end())), std::length_error);
+}
+
+TEST(Boggle, CompiledMatchesTrie)
+{
+    auto board = make_random_board(50, 50, 1);
+    auto words = make_random_words(2500, 2);
+    boggle::trie<char> dictionary;
+    for (auto const& s : words) { dictionary.insert_sequence(s); }
+    boggle::compiled_trie<char> compiled{ words.begin(), words.end() };
+
+    auto expected = boggle::solve(board, dictionary);
+    ASSERT_FALSE(expected.empty());
+    ASSERT_EQ(boggle::solve(board, compiled), expected);
+}
+
+TEST(Boggle, BulkBuildMatchesInsert)
+{
+    auto board = make_random_board(50, 50, 5);
+    auto words = make_random_words(20000, 6);
+    words.push_back(words.front());
+    boggle::trie<char> expected_dictionary;
+    for (auto const& s : words) { expected_dictionary.insert_sequence(s); }
+    auto expected = boggle::solve(board, expected_dictionary);
+    ASSERT_FALSE(expected.empty());
+
+    auto sorted = words;
+    std::sort(sorted.begin(), sorted.end());
+    for (auto const* input : { &words, &sorted })
+    {
+        for (unsigned thread_count : { 1, 2, 3, 64 })
+        {
+            boggle::trie<char> dictionary{ input->begin(), input->end(), thread_count };
+            ASSERT_EQ(boggle::compiled_trie<char>{ dictionary }.word_count(), boggle::compiled_trie<char>{ expected_dictionary }.word_count());
+            ASSERT_EQ(boggle::solve(board, dictionary), expected);
+        }
+    }
+
+    // A bulk-built trie can still have words added one at a time
+    boggle::trie<char> dictionary{ words.begin(), words.end(), 2 };
+    ASSERT_FALSE(dictionary.contains_sequence(std::string{ "zzzzzzzz" }));
+    dictionary.insert_sequence(std::string{ "zzzzzzzz" });
+    ASSERT_TRUE(dictionary.contains_sequence(std::string{ "zzzzzzzz" }));
+    ASSERT_TRUE(dictionary.contains_sequence(words.back()));
+}
+
+TEST(Boggle, ReadTrie)
+{
+    std::istringstream list{ "then\r\nhen\n\nher\nher\nfew" };
+    auto dictionary = boggle::trie<char>::read(list, 2);
+    for (auto const& s : { "then", "hen", "her", "few" })
+    {
+        ASSERT_TRUE(dictionary.contains_sequence(std::string{ s }));
+    }
+    ASSERT_FALSE(dictionary.contains_sequence(std::string{ "he" }));
+    ASSERT_FALSE(dictionary.contains_sequence(std::string{}));
+    ASSERT_EQ(boggle::compiled_trie<char>{ dictionary }.word_count(), 4u);
+
+    std::vector<std::string> with_empty{ "b", "", "a" };
+    ASSERT_TRUE((boggle::trie<char>{ with_empty.begin(), with_empty.end(), 2 }.contains_sequence(std::string{})));
+    ASSERT_THROW(boggle::trie<char>::load("/nonexistent/words.txt"), std::runtime_error);
+}
+
+TEST(Boggle, ParallelMatchesSerial)
+{
+    auto board = make_random_board(50, 50, 3);
+    auto words = make_random_words(2500, 4);
+    boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+
+    auto expected = boggle::solve(board, dictionary);
+    ASSERT_FALSE(expected.empty());
+    for (unsigned thread_count : { 1, 2, 3, 8, 64 })
+    {
+        ASSERT_EQ(boggle::solve(board, dictionary, thread_count), expected);
+    }
+}
+
+TEST(Boggle, BatchMatchesSolve)
+{
+    auto words = make_random_words(20000, 5);
+    boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+    std::vector<boggle::board<char>> boards;
+    for (unsigned i = 0; i < 100; ++i)
+    {
+        boards.push_back(make_random_board(5, 5, 100 + i));
+    }
+
+    boggle::solver<boggle::compiled_trie<char>> solver{ dictionary, 4 };
+    std::vector<boggle::solver<boggle::compiled_trie<char>>::result> results(boards.size());
+    for (int batch = 0; batch < 2; ++batch)
+    {
+        solver.solve(boards.begin(), boards.end(), results.begin());
+        for (std::size_t i = 0; i < boards.size(); ++i)
+        {
+            std::vector<std::string> found;
+            for (auto id : results[i]) { found.push_back(dictionary.spelling(id)); }
+            auto expected = boggle::solve(boards[i], dictionary);
+            ASSERT_EQ(found, std::vector<std::string>(expected.begin(), expected.end()));
+        }
+    }
+    ASSERT_EQ(solver.solve(boards[0]), results[0]);
+}
+
+TEST(Boggle, WordSet)
+{
+    std::vector<std::string> words{ "blow", "blower", "brew", "fern", "few", "hen", "her", "lower", "then" };
+    boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+    boggle::word_set<boggle::compiled_trie<char>> set{ dictionary };
+    ASSERT_TRUE(set.empty());
+    ASSERT_TRUE(set.begin() == set.end());
+
+    ASSERT_TRUE(set.insert(7));
+    ASSERT_TRUE(set.insert(2));
+    ASSERT_FALSE(set.insert(7));
+    ASSERT_EQ(set.size(), 2u);
+    ASSERT_TRUE(set.contains(2));
+    ASSERT_FALSE(set.contains(3));
+    ASSERT_EQ(std::vector<boggle::compiled_trie<char>::word_id>(set.begin(), set.end()), (std::vector<boggle::compiled_trie<char>::word_id>{ 2, 7 }));
+    ASSERT_EQ(set.strings(), (std::set<std::string>{ "brew", "lower" }));
+
+    set.clear();
+    ASSERT_TRUE(set.empty());
+    ASSERT_TRUE(set.begin() == set.end());
+}
+
+TEST(Boggle, WordSetMatchesSolve)
+{
+    auto board = make_random_board(50, 50, 6);
+    auto words = make_random_words(2500, 7);
+    boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+    auto expected = boggle::solve(board, dictionary);
+
+    boggle::word_set<boggle::compiled_trie<char>> found{ dictionary };
+    boggle::solve(board, dictionary, found);
+    ASSERT_EQ(found.size(), expected.size());
+    ASSERT_EQ(found.strings(), expected);
+
+    boggle::solver<boggle::compiled_trie<char>> solver{ dictionary };
+    found.clear();
+    solver.solve(board, found);
+    ASSERT_EQ(found.strings(), expected);
+}
+
+TEST(Boggle, DictionaryFile)
+{
+    auto board = make_random_board(50, 50, 8);
+    auto words = make_random_words(2500, 9);
+    boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+    auto expected = boggle::solve(board, dictionary);
+
+    std::ostringstream saved;
+    dictionary.save(saved);
+    auto bytes = saved.str();
+    auto view = [](std::string const& bytes)
+    {
+        auto buffer = std::make_shared<std::vector<std::uint64_t>>((bytes.size() + 7) / 8);
+        std::memcpy(buffer->data(), bytes.data(), bytes.size());
+        return boggle::compiled_trie<char>::view(buffer->data(), bytes.size(), buffer);
+    };
+
+    auto viewed = view(bytes);
+    ASSERT_EQ(viewed.word_count(), dictionary.word_count());
+    ASSERT_EQ(viewed.node_count(), dictionary.node_count());
+    ASSERT_EQ(viewed.spelling(17), dictionary.spelling(17));
+    ASSERT_EQ(boggle::solve(board, viewed), expected);
+
+    ASSERT_THROW(view(bytes.substr(0, bytes.size() - 1)), std::runtime_error);
+    ASSERT_THROW(view(bytes.substr(0, 16)), std::runtime_error);
+    auto corrupt = bytes;
+    corrupt[0] = 'X';
+    ASSERT_THROW(view(corrupt), std::runtime_error);
+    corrupt = bytes;
+    corrupt[56 + 8] = '\xFF'; // the root node's first child, just after the 56-byte header
+    corrupt[56 + 11] = '\x7F';
+    ASSERT_THROW(view(corrupt), std::runtime_error);
+
+    auto path = std::string{ "boggle-test.dict" };
+    {
+        std::ofstream file{ path, std::ios::binary };
+        dictionary.save(file);
+    }
+    auto mapped = boggle::map_dictionary<char>(path);
+    std::remove(path.c_str());
+    ASSERT_EQ(boggle::solve(board, mapped), expected);
+    ASSERT_THROW(boggle::map_dictionary<char>(path), std::system_error);
+}
+
+TEST(Boggle, StreamMatchesSolve)
+{
+    auto board = make_random_board(20, 300, 10);
+    auto words = make_random_words(20000, 11);
+    boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+    boggle::trie<char> trie;
+    for (auto const& s : words) { trie.insert_sequence(s); }
+    auto expected = boggle::solve(board, dictionary);
+    ASSERT_FALSE(expected.empty());
+
+    std::ostringstream text;
+    text << board;
+
+    std::vector<std::string> found;
+    std::istringstream compiled_source{ text.str() };
+    boggle::solve_stream(compiled_source, dictionary, [&found](std::string const& word) { found.push_back(word); });
+    ASSERT_EQ(std::set<std::string>(found.begin(), found.end()), expected);
+    ASSERT_EQ(found.size(), expected.size());
+
+    found.clear();
+    std::istringstream trie_source{ text.str() };
+    boggle::solve_stream(trie_source, trie, 7, [&found](std::string const& word) { found.push_back(word); });
+    ASSERT_EQ(std::set<std::string>(found.begin(), found.end()), expected);
+
+    // A limit shorter than the dictionary's longest word gives exactly the words within it, wherever the blocks fall
+    boggle::search_options limited;
+    limited.max_length = 4;
+    auto expected_limited = boggle::solve(board, dictionary, limited);
+    ASSERT_FALSE(expected_limited.empty());
+    ASSERT_LT(expected_limited.size(), expected.size());
+    found.clear();
+    std::istringstream compiled_limited_source{ text.str() };
+    boggle::solve_stream(compiled_limited_source, dictionary, 4, [&found](std::string const& word) { found.push_back(word); });
+    ASSERT_EQ(std::set<std::string>(found.begin(), found.end()), expected_limited);
+    found.clear();
+    std::istringstream trie_limited_source{ text.str() };
+    boggle::solve_stream(trie_limited_source, trie, 4, [&found](std::string const& word) { found.push_back(word); });
+    ASSERT_EQ(std::set<std::string>(found.begin(), found.end()), expected_limited);
+
+    std::istringstream ragged{ "abc\nab\n" };
+    ASSERT_THROW(boggle::solve_stream(ragged, dictionary, [](std::string const&) {}), std::runtime_error);
+}
+
+TEST(Boggle, IterativeMatchesRecursive)
+{
+    auto board = make_random_board(50, 50, 12);
+    auto words = make_random_words(20000, 13);
+    boggle::trie<char> trie;
+    for (auto const& s : words) { trie.insert_sequence(s); }
+    boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+
+    auto expected = boggle::solve(board, dictionary);
+    ASSERT_EQ(boggle::solve(board, dictionary, boggle::search_options{}), expected);
+    ASSERT_EQ(boggle::solve(board, trie, boggle::search_options{}), expected);
+
+    boggle::search_options options;
+    options.min_length = 4;
+    options.max_length = 6;
+    std::set<std::string> limited;
+    std::copy_if(expected.begin(), expected.end(), std::inserter(limited, limited.end()), [](std::string const& s) { return s.length() >= 4 && s.length() <= 6; });
+    ASSERT_EQ(boggle::solve(board, dictionary, options), limited);
+
+    options.max_length = 0;
+    ASSERT_TRUE(boggle::solve(board, dictionary, options).empty());
+
+    auto tiny = make_random_board(2, 2, 14);
+    std::vector<std::string> tiny_words{ std::string{ tiny(0, 0), tiny(1, 0), tiny(1, 1), tiny(0, 1) } };
+    boggle::compiled_trie<char> tiny_dictionary{ tiny_words.begin(), tiny_words.end() };
+    ASSERT_EQ(boggle::solve(tiny, tiny_dictionary, boggle::search_options{}).size(), 1u);
+}
+
+TEST(Boggle, SolveTop)
+{
+    auto board = make_random_board(20, 20, 7);
+    auto words = make_random_words(20000, 8);
+    boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+    boggle::score_table<char> table;
+    table.letters = { { 'q', 10 }, { 'z', 10 }, { 'x', 8 }, { 'j', 8 } };
+    boggle::scored_dictionary<char> scored{ dictionary, table };
+
+    // The same words as scoring everything found, and sorting it
+    std::vector<std::pair<std::uint32_t, std::string>> all;
+    for (auto const& w : boggle::solve(board, dictionary))
+    {
+        if (table.score(w) > 0) { all.emplace_back(table.score(w), w); }
+    }
+    std::sort(all.begin(), all.end(), [](auto const& a, auto const& b) { return a.first > b.first || (a.first == b.first && a.second < b.second); });
+    ASSERT_GT(all.size(), 20u);
+
+    for (std::size_t k : { std::size_t{ 0 }, std::size_t{ 1 }, std::size_t{ 10 }, all.size(), all.size() + 100 })
+    {
+        auto top = boggle::solve_top(board, scored, k);
+        ASSERT_EQ(top.size(), std::min(k, all.size()));
+        for (std::size_t i = 0; i < top.size(); ++i)
+        {
+            ASSERT_EQ(top[i].score, all[i].first);
+            ASSERT_EQ(top[i].word, all[i].second);
+            ASSERT_EQ(dictionary.spelling(top[i].id), top[i].word);
+
+            // Each path spells its word out, through neighbouring cells, using each cell once
+            ASSERT_EQ(top[i].path.size(), top[i].word.length());
+            std::set<std::pair<int, int>> cells;
+            for (std::size_t j = 0; j < top[i].path.size(); ++j)
+            {
+                auto p = top[i].path[j];
+                ASSERT_EQ(board(p.x, p.y), top[i].word[j]);
+                ASSERT_TRUE(cells.emplace(p.x, p.y).second);
+                if (j > 0)
+                {
+                    auto q = top[i].path[j - 1];
+                    ASSERT_LE(std::abs(p.x - q.x), 1);
+                    ASSERT_LE(std::abs(p.y - q.y), 1);
+                }
+            }
+        }
+    }
+}
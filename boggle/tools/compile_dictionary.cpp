@@ -0,0 +1,44 @@
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "boggle/compiled_trie.hpp"
+
+// Compile a word list (one word per line) into a dictionary file, for map_dictionary() to use directly
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "usage: " << argv[0] << " <word list> <dictionary file>" << std::endl;
+        return 2;
+    }
+
+    try
+    {
+        std::ifstream input{ argv[1] };
+        if (!input) { throw std::runtime_error(std::string{ "can't open " } + argv[1]); }
+        std::vector<std::string> words;
+        for (std::string line; std::getline(input, line);)
+        {
+            if (!line.empty() && line.back() == '\r') { line.pop_back(); }
+            if (!line.empty()) { words.push_back(line); }
+        }
+
+        boggle::compiled_trie<char> dictionary{ words.begin(), words.end() };
+        std::ofstream output{ argv[2], std::ios::binary };
+        if (!output) { throw std::runtime_error(std::string{ "can't create " } + argv[2]); }
+        dictionary.save(output);
+        output.close();
+        if (!output) { throw std::runtime_error(std::string{ "failed writing " } + argv[2]); }
+
+        std::cout << dictionary.word_count() << " words, " << dictionary.node_count() << " nodes" << std::endl;
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
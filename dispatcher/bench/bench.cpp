@@ -0,0 +1,321 @@
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "dispatcher/dispatcher.hpp"
+#include "dispatcher/future.hpp"
+#include "dispatcher/thread_pool.hpp"
+
+namespace
+{
+    // The original queue, one mutex and condition variable around a std::queue, kept as a baseline to measure the current one against
+    class locked_task_queue : public std::enable_shared_from_this<locked_task_queue>
+    {
+    public:
+        using process_result = dispatcher::task_queue::process_result;
+
+        template<typename TFunctor>
+        auto enque(TFunctor&& f)
+        {
+            std::packaged_task<decltype(f())()> task{ std::forward<TFunctor>(f) };
+            auto future = task.get_future();
+            std::unique_lock<std::mutex> guard{ _mutex };
+            _tasks.push(std::packaged_task<void()>{ std::move(task) });
+            _cv.notify_one();
+            return future;
+        }
+
+        process_result process()
+        {
+            while (true)
+            {
+                std::packaged_task<void()> t;
+                {
+                    std::unique_lock<std::mutex> guard{ _mutex };
+                    while (_tasks.empty() && !_done) { _cv.wait(guard); }
+                    if (_tasks.empty()) { return process_result::finished; }
+                    t = std::move(_tasks.front());
+                    _tasks.pop();
+                }
+                t();
+            }
+        }
+
+        std::future<process_result> process_on_new_thread()
+        {
+            return std::async(std::launch::async, [shared = shared_from_this()]() { return shared->process(); });
+        }
+
+        void finish()
+        {
+            std::unique_lock<std::mutex> guard{ _mutex };
+            _done = true;
+            _cv.notify_all();
+        }
+
+    private:
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        bool _done = false;
+        std::queue<std::packaged_task<void()>> _tasks;
+    };
+
+    // Enqueue a batch of tiny tasks (batch size in range(0)), then process them all synchronously on this thread; items per second is tasks per second through the queue, with no contention
+    template<typename TQueue>
+    void BM_EnqueProcess(benchmark::State& state)
+    {
+        std::vector<std::future<int>> results;
+        results.reserve(state.range(0));
+        for (auto _ : state)
+        {
+            auto queue = std::make_shared<TQueue>();
+            results.clear();
+            for (int i = 0; i < state.range(0); ++i)
+            {
+                results.push_back(queue->enque([i]() { return i; }));
+            }
+            queue->finish();
+            queue->process();
+            benchmark::DoNotOptimize(results.back().get());
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK_TEMPLATE(BM_EnqueProcess, dispatcher::task_queue)->Arg(1000)->Arg(100000)->Unit(benchmark::kMicrosecond);
+    BENCHMARK_TEMPLATE(BM_EnqueProcess, locked_task_queue)->Arg(1000)->Arg(100000)->Unit(benchmark::kMicrosecond);
+
+    // The same, through post(), with no futures at all
+    void BM_PostProcess(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            auto queue = std::make_shared<dispatcher::task_queue>();
+            int sum = 0;
+            for (int i = 0; i < state.range(0); ++i)
+            {
+                queue->post([&sum, i]() { sum += i; });
+            }
+            queue->finish();
+            queue->process();
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(BM_PostProcess)->Arg(1000)->Arg(100000)->Unit(benchmark::kMicrosecond);
+
+    // The same as BM_EnqueProcess, but every task is enqueued with a cancellation token (one shared by the whole batch); with range(1) set, the batch is cancelled rather than run
+    void BM_EnqueCancellable(benchmark::State& state)
+    {
+        std::vector<std::future<int>> results;
+        results.reserve(state.range(0));
+        for (auto _ : state)
+        {
+            auto queue = std::make_shared<dispatcher::task_queue>();
+            dispatcher::cancellation_source source;
+            results.clear();
+            for (int i = 0; i < state.range(0); ++i)
+            {
+                results.push_back(queue->enque([i]() { return i; }, source.token()));
+            }
+            if (state.range(1)) { source.cancel(); }
+            queue->finish();
+            queue->process();
+            benchmark::DoNotOptimize(results.back().wait_for(std::chrono::seconds{ 0 }));
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(BM_EnqueCancellable)->ArgsProduct({ { 1000, 100000 }, { 0, 1 } })->Unit(benchmark::kMicrosecond);
+
+    // Producers (count in range(0)) enqueueing 100k tiny tasks between them, while workers (count in range(1)) run them
+    template<typename TQueue>
+    void BM_Contended(benchmark::State& state)
+    {
+        auto const task_count = 100000;
+        auto const producer_count = static_cast<int>(state.range(0));
+        for (auto _ : state)
+        {
+            auto queue = std::make_shared<TQueue>();
+            std::vector<std::future<dispatcher::task_queue::process_result>> workers;
+            for (int i = 0; i < state.range(1); ++i)
+            {
+                workers.push_back(queue->process_on_new_thread());
+            }
+            std::vector<std::thread> producers;
+            for (int p = 0; p < producer_count; ++p)
+            {
+                producers.emplace_back([&queue, task_count, producer_count]()
+                {
+                    for (int i = 0; i < task_count / producer_count; ++i)
+                    {
+                        queue->enque([]() {});
+                    }
+                });
+            }
+            for (auto& producer : producers) { producer.join(); }
+            queue->finish();
+            for (auto& worker : workers) { worker.get(); }
+        }
+        state.SetItemsProcessed(state.iterations() * (task_count / producer_count) * producer_count);
+    }
+    BENCHMARK_TEMPLATE(BM_Contended, dispatcher::task_queue)->ArgsProduct({ { 1, 4 }, { 1, 4 } })->UseRealTime()->Unit(benchmark::kMillisecond);
+    BENCHMARK_TEMPLATE(BM_Contended, locked_task_queue)->ArgsProduct({ { 1, 4 }, { 1, 4 } })->UseRealTime()->Unit(benchmark::kMillisecond);
+
+    // Tasks that enqueue follow-up tasks, from inside the workers (count in range(0)): each of 100 root tasks spawns 1000 children, which stay on the spawning worker's own deque unless stolen
+    void BM_NestedSpawn(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            auto queue = std::make_shared<dispatcher::task_queue>();
+            std::vector<std::future<dispatcher::task_queue::process_result>> workers;
+            for (int i = 0; i < state.range(0); ++i)
+            {
+                workers.push_back(queue->process_on_new_thread());
+            }
+            std::vector<std::future<void>> roots;
+            for (int i = 0; i < 100; ++i)
+            {
+                roots.push_back(queue->enque([&queue]()
+                {
+                    for (int j = 0; j < 1000; ++j) { queue->enque([]() {}); }
+                }));
+            }
+            for (auto& root : roots) { root.get(); }
+            queue->finish();
+            for (auto& worker : workers) { worker.get(); }
+        }
+        state.SetItemsProcessed(state.iterations() * 100 * 1001);
+    }
+    BENCHMARK(BM_NestedSpawn)->Arg(1)->Arg(4)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+    // Fan-out: submitting 10k tasks at once to a running pool of workers (count in range(0)), one enque at a time or in a single enque_bulk (range(1) says which), and waiting for them all
+    void BM_FanOut(benchmark::State& state)
+    {
+        auto queue = std::make_shared<dispatcher::task_queue>();
+        std::vector<std::future<dispatcher::task_queue::process_result>> workers;
+        for (int i = 0; i < state.range(0); ++i)
+        {
+            workers.push_back(queue->process_on_new_thread());
+        }
+        std::vector<std::function<int()>> work(10000, []() { return 42; });
+        std::vector<std::future<int>> results;
+        results.reserve(work.size());
+        for (auto _ : state)
+        {
+            if (state.range(1))
+            {
+                results = queue->enque_bulk(work);
+            }
+            else
+            {
+                results.clear();
+                for (auto const& f : work) { results.push_back(queue->enque(f)); }
+            }
+            for (auto& result : results) { benchmark::DoNotOptimize(result.get()); }
+        }
+        queue->finish();
+        for (auto& worker : workers) { worker.get(); }
+        state.SetItemsProcessed(state.iterations() * work.size());
+    }
+    BENCHMARK(BM_FanOut)->ArgsProduct({ { 1, 4 }, { 0, 1 } })->UseRealTime()->Unit(benchmark::kMillisecond);
+
+    // The same fan-out (one enque at a time) to an elastic pool, which starts with one thread and may grow to range(0)
+    void BM_FanOutThreadPool(benchmark::State& state)
+    {
+        auto queue = std::make_shared<dispatcher::task_queue>();
+        dispatcher::pool_options options;
+        options.max_threads = static_cast<unsigned>(state.range(0));
+        dispatcher::thread_pool pool{ queue, options };
+        std::vector<std::function<int()>> work(10000, []() { return 42; });
+        std::vector<std::future<int>> results;
+        results.reserve(work.size());
+        for (auto _ : state)
+        {
+            results.clear();
+            for (auto const& f : work) { results.push_back(queue->enque(f)); }
+            for (auto& result : results) { benchmark::DoNotOptimize(result.get()); }
+        }
+        pool.join();
+        state.SetItemsProcessed(state.iterations() * work.size());
+    }
+    BENCHMARK(BM_FanOutThreadPool)->Arg(1)->Arg(4)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+    // Latency of urgent tasks under a background load: two workers work through a backlog of ~5us low priority tasks, topped up by 50 before each urgent task. range(0) says whether the urgent tasks go in at high priority, or at the same priority as the backlog (so first come, first served, as everything used to be). Reports p50 and p99 of the time from enqueue to the urgent task starting.
+    void BM_MixedLoadLatency(benchmark::State& state)
+    {
+        using clock = std::chrono::steady_clock;
+        auto const urgent_priority = state.range(0) ? dispatcher::task_queue::priority::high : dispatcher::task_queue::priority::low;
+        auto queue = std::make_shared<dispatcher::task_queue>();
+        std::vector<std::future<dispatcher::task_queue::process_result>> workers;
+        for (int i = 0; i < 2; ++i)
+        {
+            workers.push_back(queue->process_on_new_thread());
+        }
+        auto background = []()
+        {
+            auto until = clock::now() + std::chrono::microseconds{ 5 };
+            while (clock::now() < until) {}
+        };
+        std::vector<double> latencies;
+        for (auto _ : state)
+        {
+            for (int i = 0; i < 50; ++i) { queue->enque(background, dispatcher::task_queue::priority::low); }
+            auto enqueued = clock::now();
+            auto started = queue->enque([]() { return clock::now(); }, urgent_priority).get();
+            latencies.push_back(std::chrono::duration<double, std::micro>(started - enqueued).count());
+        }
+        queue->interrupt();
+        for (auto& worker : workers) { worker.get(); }
+        std::sort(latencies.begin(), latencies.end());
+        state.counters["p50_us"] = latencies[latencies.size() / 2];
+        state.counters["p99_us"] = latencies[latencies.size() * 99 / 100];
+    }
+    BENCHMARK(BM_MixedLoadLatency)->Arg(0)->Arg(1)->Iterations(2000)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+    // A chain of 1000 dependent steps, each run on a worker once the previous one is done: with then(), or by the caller blocking on each step's future and enqueueing the next (range(0) says which)
+    void BM_Chain(benchmark::State& state)
+    {
+        auto queue = std::make_shared<dispatcher::task_queue>();
+        auto worker = queue->process_on_new_thread();
+        for (auto _ : state)
+        {
+            if (state.range(0))
+            {
+                auto f = queue->submit([]() { return 0; });
+                for (int i = 1; i < 1000; ++i) { f = f.then([](dispatcher::future<int> previous) { return previous.get() + 1; }); }
+                benchmark::DoNotOptimize(f.get());
+            }
+            else
+            {
+                auto value = queue->enque([]() { return 0; }).get();
+                for (int i = 1; i < 1000; ++i) { value = queue->enque([value]() { return value + 1; }).get(); }
+                benchmark::DoNotOptimize(value);
+            }
+        }
+        queue->finish();
+        worker.get();
+        state.SetItemsProcessed(state.iterations() * 1000);
+    }
+    BENCHMARK(BM_Chain)->Arg(0)->Arg(1)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+    // The round trip for one task through a queue with an idle worker waiting on it: enqueue, wake the worker, run, and wait for the result
+    void BM_Latency(benchmark::State& state)
+    {
+        auto queue = std::make_shared<dispatcher::task_queue>();
+        auto worker = queue->process_on_new_thread();
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(queue->enque([]() { return 42; }).get());
+        }
+        queue->finish();
+        worker.get();
+    }
+    BENCHMARK(BM_Latency)->UseRealTime()->Unit(benchmark::kMicrosecond);
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,72 @@
+
+#include <benchmark/benchmark.h>
+#include <memory>
+
+#include "dispatcher/coroutine.hpp"
+
+namespace
+{
+    // One hop onto the queue and back per step: a coroutine co_awaiting schedule() 1000 times in a row, against the caller enqueueing 1000 tasks one after another and blocking on each one's future
+    void BM_CoroutineSchedule(benchmark::State& state)
+    {
+        auto queue = std::make_shared<dispatcher::task_queue>();
+        auto worker = queue->process_on_new_thread();
+        auto hops = [](dispatcher::task_queue& queue) -> dispatcher::task<int>
+        {
+            int count = 0;
+            for (int i = 0; i < 1000; ++i)
+            {
+                co_await queue.schedule();
+                ++count;
+            }
+            co_return count;
+        };
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(dispatcher::sync_wait(hops(*queue)));
+        }
+        queue->finish();
+        worker.get();
+        state.SetItemsProcessed(state.iterations() * 1000);
+    }
+    BENCHMARK(BM_CoroutineSchedule)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+    void BM_EnqueGet(benchmark::State& state)
+    {
+        auto queue = std::make_shared<dispatcher::task_queue>();
+        auto worker = queue->process_on_new_thread();
+        for (auto _ : state)
+        {
+            int count = 0;
+            for (int i = 0; i < 1000; ++i)
+            {
+                count = queue->enque([count]() { return count + 1; }).get();
+            }
+            benchmark::DoNotOptimize(count);
+        }
+        queue->finish();
+        worker.get();
+        state.SetItemsProcessed(state.iterations() * 1000);
+    }
+    BENCHMARK(BM_EnqueGet)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+    // Awaiting another coroutine 1000 times, which doesn't go through the queue at all: the cost of a coroutine call and return
+    void BM_CoroutineAwaitTask(benchmark::State& state)
+    {
+        auto one = []() -> dispatcher::task<int> { co_return 1; };
+        auto sum = [one]() -> dispatcher::task<int>
+        {
+            int total = 0;
+            for (int i = 0; i < 1000; ++i) { total += co_await one(); }
+            co_return total;
+        };
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(dispatcher::sync_wait(sum()));
+        }
+        state.SetItemsProcessed(state.iterations() * 1000);
+    }
+    BENCHMARK(BM_CoroutineAwaitTask)->Unit(benchmark::kMicrosecond);
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,164 @@
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace dispatcher
+{
+    namespace detail
+    {
+        // A fixed-capacity, lock-free, multi-producer multi-consumer FIFO queue (after Dmitry Vyukov's design). Each cell carries a sequence number which says whether it's ready to be written or read on the current lap around the ring, so producers and consumers each only need a single compare-and-swap on their own position to claim a cell, and never touch each other's.
+        template<typename T>
+        class bounded_queue
+        {
+        public:
+            // The capacity is rounded up to a power of two
+            explicit bounded_queue(std::size_t capacity) : _mask{ round_up(capacity) - 1 }, _cells{ new cell[_mask + 1] }
+            {
+                for (std::size_t i = 0; i <= _mask; ++i)
+                {
+                    _cells[i].sequence.store(i, std::memory_order_relaxed);
+                }
+            }
+
+            bounded_queue(bounded_queue const&) = delete;
+            bounded_queue& operator=(bounded_queue const&) = delete;
+
+            std::size_t capacity() const { return _mask + 1; }
+
+            // Add an item to the back, unless the queue is full (in which case the item is left alone, and this returns false)
+            bool try_push(T& value)
+            {
+                auto position = _enqueue_position.load(std::memory_order_relaxed);
+                while (true)
+                {
+                    auto& c = _cells[position & _mask];
+                    auto sequence = c.sequence.load(std::memory_order_acquire);
+                    auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+                    if (difference == 0)
+                    {
+                        if (_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                        {
+                            c.value = std::move(value);
+                            c.sequence.store(position + 1, std::memory_order_release);
+                            return true;
+                        }
+                    }
+                    else if (difference < 0)
+                    {
+                        return false;
+                    }
+                    else
+                    {
+                        position = _enqueue_position.load(std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            // Take the item from the front, unless the queue is empty (or the item at the front is still being written)
+            bool try_pop(T& value)
+            {
+                auto position = _dequeue_position.load(std::memory_order_relaxed);
+                while (true)
+                {
+                    auto& c = _cells[position & _mask];
+                    auto sequence = c.sequence.load(std::memory_order_acquire);
+                    auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+                    if (difference == 0)
+                    {
+                        if (_dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                        {
+                            value = std::move(c.value);
+                            c.value = T{};
+                            c.sequence.store(position + _mask + 1, std::memory_order_release);
+                            return true;
+                        }
+                    }
+                    else if (difference < 0)
+                    {
+                        return false;
+                    }
+                    else
+                    {
+                        position = _dequeue_position.load(std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            // Take up to `max` items from the front at once, handing each to the given function in order, and return how many there were. The whole run is claimed with a single compare-and-swap, so a consumer taking a batch pays for one round-trip, not one per item.
+            template<typename TFunctor>
+            std::size_t try_pop_bulk(std::size_t max, TFunctor&& f)
+            {
+                auto position = _dequeue_position.load(std::memory_order_relaxed);
+                while (true)
+                {
+                    // Count how many cells from here on are ready to read (stopping at the first one that isn't)
+                    std::size_t count = 0;
+                    while (count < max)
+                    {
+                        auto& c = _cells[(position + count) & _mask];
+                        if (c.sequence.load(std::memory_order_acquire) != position + count + 1) { break; }
+                        ++count;
+                    }
+                    if (count == 0)
+                    {
+                        auto current = _dequeue_position.load(std::memory_order_relaxed);
+                        if (current == position) { return 0; }
+                        position = current;
+                        continue;
+                    }
+                    if (_dequeue_position.compare_exchange_weak(position, position + count, std::memory_order_relaxed))
+                    {
+                        for (std::size_t i = 0; i < count; ++i)
+                        {
+                            auto& c = _cells[(position + i) & _mask];
+                            f(std::move(c.value));
+                            c.value = T{};
+                            c.sequence.store(position + i + _mask + 1, std::memory_order_release);
+                        }
+                        return count;
+                    }
+                }
+            }
+
+            // How many items have been pushed and not yet popped (again, a snapshot)
+            std::size_t size() const
+            {
+                auto dequeued = _dequeue_position.load(std::memory_order_relaxed);
+                auto enqueued = _enqueue_position.load(std::memory_order_relaxed);
+                return enqueued > dequeued ? enqueued - dequeued : 0;
+            }
+
+            // Whether anything has been pushed that hasn't been popped. It's only a snapshot, of course, and an item counted here may still be being written.
+            bool empty() const { return _enqueue_position.load(std::memory_order_seq_cst) == _dequeue_position.load(std::memory_order_seq_cst); }
+
+        private:
+            struct cell
+            {
+                std::atomic<std::size_t> sequence;
+                T value;
+            };
+
+            static std::size_t round_up(std::size_t capacity)
+            {
+                std::size_t size = 2;
+                while (size < capacity) { size *= 2; }
+                return size;
+            }
+
+            // Keep the two positions on separate cache lines, so producers and consumers don't slow each other down
+            static constexpr std::size_t cache_line = 64;
+
+            std::size_t const _mask;
+            std::unique_ptr<cell[]> const _cells;
+            char _padding0[cache_line];
+            std::atomic<std::size_t> _enqueue_position{ 0 };
+            char _padding1[cache_line - sizeof(std::atomic<std::size_t>)];
+            std::atomic<std::size_t> _dequeue_position{ 0 };
+            char _padding2[cache_line - sizeof(std::atomic<std::size_t>)];
+        };
+    }
+}
@@ -0,0 +1,148 @@
+
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dispatcher/errors.hpp"
+#include "dispatcher/task.hpp"
+
+namespace dispatcher
+{
+    namespace detail
+    {
+        // Something waiting to run, which can be called off
+        class cancellable
+        {
+        public:
+            virtual ~cancellable() = default;
+            virtual void cancel() noexcept = 0;
+        };
+
+        // Shared by a cancellation_source and all its tokens: whether it's been cancelled, and what's waiting to be cancelled with it
+        class cancellation_state
+        {
+        public:
+            bool cancelled() const { return _cancelled.load(std::memory_order_acquire); }
+
+            // Anything added after the state is cancelled is cancelled straight away (and this returns false)
+            bool add(std::weak_ptr<cancellable> c);
+            void cancel();
+
+        private:
+            std::atomic<bool> _cancelled{ false };
+            std::mutex _mutex;
+            // Held weakly, so work that has already run (or been dropped) goes away as usual; the dead entries are cleared out whenever the list doubles
+            std::vector<std::weak_ptr<cancellable>> _registered;
+            std::size_t _prune_size = 16;
+        };
+    }
+
+    // Says whether work has been cancelled. A default-constructed token never is.
+    class cancellation_token
+    {
+    public:
+        cancellation_token() = default;
+
+        bool stop_requested() const { return _state && _state->cancelled(); }
+
+    private:
+        friend class cancellation_source;
+        friend class task_queue;
+
+        explicit cancellation_token(std::shared_ptr<detail::cancellation_state> state) : _state{ std::move(state) } {}
+
+        std::shared_ptr<detail::cancellation_state> _state;
+    };
+
+    // Cancels a group of tasks (or just one, if only one is enqueued with its token). Tasks which haven't started are dropped, and their futures get a task_cancelled error straight away; tasks already running carry on, but can see that they've been cancelled through this_task::stop_requested().
+    class cancellation_source
+    {
+    public:
+        cancellation_source() : _state{ std::make_shared<detail::cancellation_state>() } {}
+
+        cancellation_token token() const { return cancellation_token{ _state }; }
+        bool stop_requested() const { return _state->cancelled(); }
+        void cancel() { _state->cancel(); }
+
+    private:
+        std::shared_ptr<detail::cancellation_state> _state;
+    };
+
+    namespace this_task
+    {
+        // For long-running work to poll: whether the task running on this thread has been cancelled (through its token), or the queue running it has been interrupted
+        bool stop_requested();
+
+        // The token the running task was enqueued with (one that's never cancelled, if it wasn't)
+        cancellation_token const& token();
+    }
+
+    namespace detail
+    {
+        // Sets the running task's token for this_task, returning the one it replaces (so it can be put back, when processing nests)
+        cancellation_token const* exchange_current_token(cancellation_token const* token) noexcept;
+
+        // A promised call which can be cancelled until it starts. Cancelling it destroys the functor there and then, so whatever it holds is freed without waiting for the queue to get to it, and the future is completed with task_cancelled (as it is when any call is dropped without running).
+        template<typename T, typename TFunctor>
+        class cancellable_call : public cancellable
+        {
+        public:
+            cancellable_call(std::promise<T> promise, TFunctor f, cancellation_token token) : _token{ std::move(token) }
+            {
+                new (&_call) call_type{ std::move(promise), std::move(f) };
+            }
+
+            ~cancellable_call() override
+            {
+                if (_state.load(std::memory_order_acquire) != cancelled) { get().~call_type(); }
+            }
+
+            void run()
+            {
+                int expected = pending;
+                if (!_state.compare_exchange_strong(expected, started, std::memory_order_acq_rel)) { return; }
+                auto previous = exchange_current_token(&_token);
+                get()();
+                exchange_current_token(previous);
+            }
+
+            void cancel() noexcept override
+            {
+                int expected = pending;
+                if (!_state.compare_exchange_strong(expected, cancelled, std::memory_order_acq_rel)) { return; }
+                get().~call_type();
+            }
+
+        private:
+            using call_type = promised_call<T, TFunctor>;
+            enum state
+            {
+                pending,
+                started,
+                cancelled,
+            };
+
+            call_type& get() { return *reinterpret_cast<call_type*>(&_call); }
+
+            cancellation_token _token;
+            std::atomic<int> _state{ pending };
+            std::aligned_storage_t<sizeof(call_type), alignof(call_type)> _call;
+        };
+
+        // The queue's handle on a cancellable call (which the call's cancellation_source only holds weakly)
+        template<typename T, typename TFunctor>
+        struct cancellable_task
+        {
+            std::shared_ptr<cancellable_call<T, TFunctor>> call;
+
+            void operator()() { call->run(); }
+        };
+    }
+}
@@ -0,0 +1,227 @@
+
+#pragma once
+
+// Coroutine support, which needs C++20. The rest of the library only needs C++14, so this is a separate header.
+
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <utility>
+#include <variant>
+
+#include "dispatcher/dispatcher.hpp"
+#include "dispatcher/future.hpp"
+
+namespace dispatcher
+{
+    template<typename T = void>
+    class task;
+
+    namespace detail
+    {
+        // The part of a task's promise that doesn't depend on the result type: tasks start suspended, and when they finish, they hand control straight back to whatever was awaiting them (by symmetric transfer, so long chains of awaits don't grow the stack)
+        class task_promise_base
+        {
+        public:
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            struct final_awaitable
+            {
+                bool await_ready() noexcept { return false; }
+
+                template<typename TPromise>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<TPromise> handle) noexcept
+                {
+                    if (auto continuation = handle.promise().continuation()) { return continuation; }
+                    return std::noop_coroutine();
+                }
+
+                void await_resume() noexcept {}
+            };
+
+            final_awaitable final_suspend() noexcept { return {}; }
+
+            std::coroutine_handle<> continuation() const { return _continuation; }
+            void set_continuation(std::coroutine_handle<> continuation) { _continuation = continuation; }
+
+        private:
+            std::coroutine_handle<> _continuation;
+        };
+
+        template<typename T>
+        class task_promise : public task_promise_base
+        {
+        public:
+            dispatcher::task<T> get_return_object() noexcept;
+
+            template<typename TValue>
+            void return_value(TValue&& value) { _result.template emplace<1>(std::forward<TValue>(value)); }
+
+            void unhandled_exception() noexcept { _result.template emplace<2>(std::current_exception()); }
+
+            T result()
+            {
+                if (_result.index() == 2) { std::rethrow_exception(std::get<2>(_result)); }
+                return std::move(std::get<1>(_result));
+            }
+
+        private:
+            std::variant<std::monostate, T, std::exception_ptr> _result;
+        };
+
+        template<>
+        class task_promise<void> : public task_promise_base
+        {
+        public:
+            dispatcher::task<void> get_return_object() noexcept;
+
+            void return_void() noexcept {}
+
+            void unhandled_exception() noexcept { _error = std::current_exception(); }
+
+            void result()
+            {
+                if (_error) { std::rethrow_exception(_error); }
+            }
+
+        private:
+            std::exception_ptr _error;
+        };
+    }
+
+    // A coroutine which produces a T. It's lazy: nothing runs until it's awaited (or passed to sync_wait), and then it runs on the awaiting thread until it does some awaiting of its own; co_await queue->schedule() is how it moves onto a worker. Awaiting it gives its result (or rethrows its exception).
+    template<typename T>
+    class [[nodiscard]] task
+    {
+    public:
+        using promise_type = detail::task_promise<T>;
+
+        task(task&& other) noexcept : _handle{ std::exchange(other._handle, {}) } {}
+
+        task& operator=(task&& other) noexcept
+        {
+            if (this != &other)
+            {
+                if (_handle) { _handle.destroy(); }
+                _handle = std::exchange(other._handle, {});
+            }
+            return *this;
+        }
+
+        ~task()
+        {
+            if (_handle) { _handle.destroy(); }
+        }
+
+        auto operator co_await() && noexcept
+        {
+            struct awaitable
+            {
+                std::coroutine_handle<promise_type> handle;
+
+                bool await_ready() noexcept { return !handle || handle.done(); }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+                {
+                    handle.promise().set_continuation(awaiting);
+                    return handle;
+                }
+
+                T await_resume() { return handle.promise().result(); }
+            };
+            return awaitable{ _handle };
+        }
+
+    private:
+        friend class detail::task_promise<T>;
+
+        explicit task(std::coroutine_handle<promise_type> handle) : _handle{ handle } {}
+
+        std::coroutine_handle<promise_type> _handle;
+    };
+
+    namespace detail
+    {
+        template<typename T>
+        dispatcher::task<T> task_promise<T>::get_return_object() noexcept
+        {
+            return dispatcher::task<T>{ std::coroutine_handle<task_promise<T>>::from_promise(*this) };
+        }
+
+        inline dispatcher::task<void> task_promise<void>::get_return_object() noexcept
+        {
+            return dispatcher::task<void>{ std::coroutine_handle<task_promise<void>>::from_promise(*this) };
+        }
+
+        // A coroutine nobody awaits, which runs straight away and cleans up after itself
+        struct detached
+        {
+            struct promise_type
+            {
+                detached get_return_object() noexcept { return {}; }
+                std::suspend_never initial_suspend() noexcept { return {}; }
+                std::suspend_never final_suspend() noexcept { return {}; }
+                void return_void() noexcept {}
+                void unhandled_exception() noexcept { std::terminate(); }
+            };
+        };
+    }
+
+    // Awaiting a dispatcher::future suspends the coroutine until the future is ready, then resumes it on the future's queue, with (a copy of) the result. If that queue has been interrupted or destroyed by then, the coroutine is resumed anyway, and the co_await throws task_cancelled.
+    template<typename T>
+    auto operator co_await(future<T> f)
+    {
+        struct awaitable
+        {
+            future<T> f;
+            bool cancelled = false;
+
+            bool await_ready() const { return f.is_ready(); }
+
+            // (False if the resumption was dropped straight away, because the future's queue was already interrupted or gone, so the coroutine just carries on)
+            bool await_suspend(std::coroutine_handle<> handle)
+            {
+                auto const& state = detail::future_access::state(f);
+                detail::suspending_scope suspending{ handle.address() };
+                state->on_ready(detail::task{ detail::post_to{ state->queue(), detail::task{ detail::resumption<std::coroutine_handle<>>{ handle, cancelled } } } });
+                return !suspending.dropped();
+            }
+
+            // A copy, since the awaitable (and with it, perhaps the last reference to the future's state) is gone by the time the result is used
+            T await_resume() const
+            {
+                if (cancelled) { throw task_cancelled{}; }
+                return f.get();
+            }
+        };
+        return awaitable{ std::move(f) };
+    }
+
+    // Run a task to completion, blocking the calling thread until it's done, and return its result. (For the edge of a program, where something finally has to wait.)
+    template<typename T>
+    T sync_wait(task<T> t)
+    {
+        std::promise<T> promise;
+        auto future = promise.get_future();
+        [](task<T> t, std::promise<T>& promise) -> detail::detached
+        {
+            try
+            {
+                if constexpr (std::is_void_v<T>)
+                {
+                    co_await std::move(t);
+                    promise.set_value();
+                }
+                else
+                {
+                    promise.set_value(co_await std::move(t));
+                }
+            }
+            catch (...)
+            {
+                promise.set_exception(std::current_exception());
+            }
+        }(std::move(t), promise);
+        return future.get();
+    }
+}
@@ -1,76 +1,335 @@
 
 #pragma once
 
-#include <experimental/optional>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
 #include <functional>
 #include <future>
 #include <memory>
-#include <queue>
+#include <mutex>
+#include <utility>
+#include <vector>
 
-namespace std
-{
-    // Pretend we have C++17
-    template<typename T>
-    using optional = experimental::optional<T>;
-}
+#include "dispatcher/bounded_queue.hpp"
+#include "dispatcher/cancellation.hpp"
+#include "dispatcher/errors.hpp"
+#include "dispatcher/metrics.hpp"
+#include "dispatcher/pool.hpp"
+#include "dispatcher/ring_deque.hpp"
+#include "dispatcher/task.hpp"
 
 namespace dispatcher
 {
+    template<typename T>
+    class future;
+
+    class thread_pool;
+
     class task_queue : public std::enable_shared_from_this<task_queue>
     {
     public:
-        // Add work to the queue, represented as any sort of parameterless function-like object. The result is returned as a waitable future.
+        // Each priority has its own queue, which holds up to `capacity` tasks in a lock-free ring; beyond that, tasks spill over into a locked list, so enque never blocks or fails
+        explicit task_queue(std::size_t capacity = default_capacity) : _high{ capacity }, _normal{ capacity }, _low{ capacity }, _workers{ new worker[max_workers] } {}
+
+        // Whatever is still queued is dropped (as if the queue had been interrupted) before anything else is torn down, since dropping a coroutine's resumption resumes the coroutine, which may still use the queue
+        ~task_queue();
+
+        static constexpr std::size_t default_capacity = 1024;
+
+        // Workers take high priority work first. So that a steady stream of it can't starve everything else, every fourth task a worker takes is from the normal priority queue first, and every sixteenth from the low priority queue first (when there's anything there).
+        // That's a fixed ratio, not aging: how long a task has waited isn't tracked, so under sustained higher priority load, a low priority task's wait grows with the low priority backlog ahead of it (each task there costs up to sixteen picks), not with its own age. Aging by enqueue time would need a clock read per enqueue, which costs about as much as the enqueue itself, on every task, to serve the rare one that has waited too long; use a deadline for work that must start within a given time.
+        enum class priority
+        {
+            high,
+            normal,
+            low,
+        };
+
+        // Each thread running process() gets a deque of its own (up to this many threads; any more just share the global queue)
+        static constexpr std::size_t max_workers = 64;
+
+        // A thread that runs out of its own tasks moves up to this many at a time from the shared queue (or from another thread's deque) onto its own deque
+        static constexpr std::size_t batch_size = 16;
+
+        // Add work to the queue, represented as any sort of parameterless function-like object. The result is returned as a waitable future. (The future's shared state comes from a pool, and small functors are stored inline in the queue, so this doesn't need to touch the heap.)
         template<typename TFunctor>
         auto enque(TFunctor&& f)
         {
-            std::packaged_task<decltype(f())()> task{ std::forward<TFunctor>(f) };
-            auto future = task.get_future();
-            enque_f(std::make_unique<typed_task<decltype(f())>>(std::move(task)));
+            return enque(std::forward<TFunctor>(f), priority::normal);
+        }
+
+        template<typename TFunctor>
+        auto enque(TFunctor&& f, priority p)
+        {
+            using result_type = decltype(std::declval<std::decay_t<TFunctor>&>()());
+            auto promise = make_promise<result_type>();
+            auto future = promise.get_future();
+            enque_f(detail::task{ detail::promised_call<result_type, std::decay_t<TFunctor>>{ std::move(promise), std::forward<TFunctor>(f) } }, p);
             return future;
         }
 
+        // Add work that must start by the given deadline. If no worker has got to it by then, it's dropped, and the future gets a task_timeout error instead.
+        // The deadline is only checked when a worker takes the task from the queue: nothing watches the clock, so a task stuck behind a long backlog times out when the backlog ahead of it has been worked through, not at the deadline itself. To give up waiting at the deadline, wait on the future with that deadline too (wait_until); the task is still dropped, unrun, once a worker reaches it.
+        template<typename TFunctor>
+        auto enque(TFunctor&& f, std::chrono::steady_clock::time_point deadline, priority p = priority::normal)
+        {
+            using result_type = decltype(std::declval<std::decay_t<TFunctor>&>()());
+            auto promise = make_promise<result_type>();
+            auto future = promise.get_future();
+            enque_f(detail::task{ detail::deadline_call<result_type, std::decay_t<TFunctor>>{ { std::move(promise), std::forward<TFunctor>(f) }, deadline } }, p);
+            return future;
+        }
+
+        // The same, with the deadline that long from now (and likewise, only checked when a worker reaches the task)
+        template<typename TFunctor, typename TRep, typename TPeriod>
+        auto enque(TFunctor&& f, std::chrono::duration<TRep, TPeriod> timeout, priority p = priority::normal)
+        {
+            return enque(std::forward<TFunctor>(f), std::chrono::steady_clock::now() + timeout, p);
+        }
+
+        // Add work which can be cancelled through the given token (see cancellation_source), until it starts. If the token has been cancelled already, the work isn't enqueued at all, and the future is cancelled straight away.
+        template<typename TFunctor>
+        auto enque(TFunctor&& f, cancellation_token token, priority p = priority::normal)
+        {
+            using result_type = decltype(std::declval<std::decay_t<TFunctor>&>()());
+            using call_type = detail::cancellable_call<result_type, std::decay_t<TFunctor>>;
+            auto promise = make_promise<result_type>();
+            auto future = promise.get_future();
+            auto state = token._state;
+            auto call = std::allocate_shared<call_type>(detail::pool_allocator<call_type>{}, std::move(promise), std::forward<TFunctor>(f), std::move(token));
+            if (state && !state->add(call)) { return future; }
+            enque_f(detail::task{ detail::cancellable_task<result_type, std::decay_t<TFunctor>>{ std::move(call) } }, p);
+            return future;
+        }
+
+        // Add a whole range of work at once, returning the futures in the same order. This is cheaper than enqueueing the functors one at a time: the tasks go into the queue together, and parked workers are woken together.
+        template<typename TIter>
+        auto enque_bulk(TIter first, TIter last)
+        {
+            using functor = std::decay_t<decltype(*first)>;
+            using result_type = decltype(std::declval<functor&>()());
+            std::vector<std::future<result_type>> futures;
+            std::vector<detail::task> tasks;
+            for (; first != last; ++first)
+            {
+                auto promise = make_promise<result_type>();
+                futures.push_back(promise.get_future());
+                tasks.emplace_back(detail::promised_call<result_type, functor>{ std::move(promise), *first });
+            }
+            enque_f(tasks.data(), tasks.size(), priority::normal);
+            return futures;
+        }
+
+        template<typename TRange>
+        auto enque_bulk(TRange const& range)
+        {
+            using std::begin;
+            using std::end;
+            return enque_bulk(begin(range), end(range));
+        }
+
+        // Add work to the queue without any way to wait for it, for when the caller doesn't need the result (or arranges its own signal). This saves the cost of the future altogether. The work mustn't throw: if it does, std::terminate is called.
+        template<typename TFunctor>
+        void post(TFunctor&& f)
+        {
+            enque_f(detail::task{ std::forward<TFunctor>(f) }, priority::normal);
+        }
+
+        // Add work to the queue, like enque, but get the result back as a dispatcher::future, so further work can be chained on with then() and friends (see dispatcher/future.hpp, which defines this)
+        template<typename TFunctor>
+        auto submit(TFunctor&& f) -> future<decltype(std::declval<std::decay_t<TFunctor>&>()())>;
+
+        // An awaitable for coroutines: `co_await queue->schedule()` suspends the coroutine, and resumes it on one of the queue's workers. (See dispatcher/coroutine.hpp.) While it waits, the coroutine is just a task in the queue; it doesn't hold a thread.
+        class schedule_awaitable
+        {
+        public:
+            schedule_awaitable(task_queue& queue, priority p) : _queue{ queue }, _priority{ p } {}
+
+            bool await_ready() const noexcept { return false; }
+
+            // (Once the task is in the queue, a worker may already be running the coroutine, so nothing here may touch the awaitable after enqueuing it; unless the queue dropped the task there and then, in which case the coroutine isn't suspended after all)
+            template<typename THandle>
+            bool await_suspend(THandle handle)
+            {
+                if (_queue._state.load(std::memory_order_acquire) == interrupting)
+                {
+                    _cancelled = true;
+                    return false;
+                }
+                detail::suspending_scope suspending{ handle.address() };
+                _queue.enque_f(detail::task{ detail::resumption<THandle>{ handle, _cancelled } }, _priority);
+                return !suspending.dropped();
+            }
+
+            // If the queue is interrupted or destroyed before it gets to the coroutine, the coroutine is still resumed, but this throws task_cancelled
+            void await_resume() const
+            {
+                if (_cancelled) { throw task_cancelled{}; }
+            }
+
+        private:
+            task_queue& _queue;
+            priority _priority;
+            bool _cancelled = false;
+        };
+
+        schedule_awaitable schedule(priority p = priority::normal) { return schedule_awaitable{ *this, p }; }
+
         enum class process_result
         {
             finished,
             interrupted,
+            // Only from process(idle_timeout): there was nothing to do for that long
+            idle,
         };
 
         // Process work from the queue, until all work is finished or processing is interrupted. (Return value indicates which.) This can be run synchronously, or from a worker thread, or simultaneously from multiple threads.
+        // Tasks enqueued from inside a task go on the running thread's own deque, and it takes them back newest first, while they're still warm in its cache; a thread with nothing left of its own takes from the shared queue, and then steals the oldest tasks from other threads' deques.
         process_result process();
 
-        // Convenience method to spawn a new thread and start it processing the queue. Can be called multiple times to spawn a pool of multiple threads.
+        // The same, but also give up if there's nothing to do for the given time (for pools which shrink when they're idle)
+        process_result process(std::chrono::steady_clock::duration idle_timeout);
+
+        // Convenience method to spawn a new thread and start it processing the queue. Can be called multiple times to spawn a pool of multiple threads. (The threads are detached; for a pool that can be joined, resized or pinned, see dispatcher::thread_pool.)
         std::future<process_result> process_on_new_thread();
 
+        // Roughly how many tasks are waiting to run (it's only a snapshot, of course, and may be a little out even as a snapshot, as it's not taken all at once)
+        std::size_t size() const;
+
+        // What the queue has done so far, by worker slot: how much was enqueued, run and stolen, how long tasks waited and ran, and so on (see metrics.hpp). Only the current depths are filled in unless the queue is built with DISPATCHER_METRICS, which costs a couple of clock reads and a few uncontended atomic increments per task.
+        metrics_snapshot metrics() const;
+
+        // Record every task run from now until stop_trace(), which returns them (for write_chrome_trace). Tasks run by threads without a worker slot aren't recorded, and without DISPATCHER_METRICS nothing is.
+        void start_trace();
+        std::vector<trace_event> stop_trace();
+
         // Signal the queue to finish, once all enqueued work is done
         void finish();
 
-        // Signal the queue to interrupt processing. All tasks actively being processed will complete, but no further tasks will be processed.
+        // Signal the queue to interrupt processing. All tasks actively being processed will complete (they can see the interruption coming through this_task::stop_requested()), as will any a worker had already taken from the queue before the interrupt, but no further tasks will be processed: those still queued, and any enqueued afterwards, are dropped, and their futures get a task_cancelled error.
         void interrupt();
 
     private:
-        // A simple wrapper class for type erasure (the processing queue just needs to invoke tasks, it doesn't see the return type passed to the waiting future)
-        class task
+        friend bool this_task::stop_requested();
+        friend class thread_pool;
+
+        enum state
         {
-        public:
-            virtual ~task() {}
-            virtual void operator()() = 0;
+            running,
+            finishing,
+            interrupting,
         };
+        std::atomic<int> _state{ running };
 
-        template<typename T>
-        class typed_task : public task
+        // The shared queue for one priority: a lock-free ring, and once that fills up, a locked list that new tasks go to until it's drained again (so tasks still come out in the order they went in)
+        class lane
         {
         public:
-            typed_task(std::packaged_task<T()>&& task) : _task{ std::move(task) } {}
-            virtual void operator()() override { _task(); }
+            explicit lane(std::size_t capacity) : _ring{ capacity } {}
+
+            void push(detail::task* tasks, std::size_t count);
+            bool try_pop(detail::task& t);
+            // Take up to `max` tasks at once, handing each to the given function in order
+            template<typename TFunctor>
+            std::size_t try_pop_bulk(std::size_t max, TFunctor&& f);
+            bool empty() const;
+            std::size_t size() const;
+
+            detail::counter contended;
+
         private:
-            std::packaged_task<T()> _task;
+            detail::bounded_queue<detail::task> _ring;
+            std::mutex _overflow_mutex;
+            std::deque<detail::task> _overflow;
+            std::atomic<std::size_t> _overflow_size{ 0 };
         };
+        lane _high;
+        lane _normal;
+        lane _low;
 
+        // One thread's own tasks. The owner pushes and pops at the back, thieves take from the front; the lock is only contended when someone is stealing.
+        struct worker
+        {
+            std::atomic<bool> claimed{ false };
+            std::mutex mutex;
+            detail::ring_deque<detail::task> tasks{ 2 * batch_size };
+            std::atomic<std::size_t> size{ 0 };
+            // How many tasks this thread has taken, for deciding when lower priorities get their turn
+            unsigned picks = 0;
+            detail::worker_counters counters;
+#ifdef DISPATCHER_METRICS
+            // When the last task this thread ran finished (if it hasn't parked since)
+            std::chrono::steady_clock::time_point last_finish;
+            std::mutex trace_mutex;
+            std::vector<trace_event> trace;
+#endif
+        };
+        std::unique_ptr<worker[]> _workers;
+        // How many worker slots have ever been claimed, so thieves don't scan the whole array
+        std::atomic<std::size_t> _worker_count{ 0 };
+
+        // The queue (if any) the current thread is processing, and its deque there
+        struct worker_context
+        {
+            task_queue* queue;
+            worker* self;
+        };
+        static thread_local worker_context _current;
+
+        // For threads without a slot of their own on this queue: a few sets of counters, padded apart so no two share a cache line, with each thread always counting in the same one (handed out in turn, as threads first need one), so up to that many producers don't contend over them. A snapshot adds them all up.
+#ifdef DISPATCHER_METRICS
+        static constexpr std::size_t external_shards = 16;
+#else
+        static constexpr std::size_t external_shards = 1;
+#endif
+        struct external_counters
+        {
+            detail::worker_counters counters;
+            // Padded rather than aligned, since before C++17 new doesn't honour alignment beyond max_align_t
+            char padding[64];
+        };
+        std::array<external_counters, external_shards> _external;
+#ifdef DISPATCHER_METRICS
+        std::atomic<bool> _tracing{ false };
+#endif
+
+        // Workers with nothing to do park on the condition variable. The mutex is only taken by a producer when the sleeper count says someone is parked, so a busy queue never touches it.
         std::mutex _mutex;
         std::condition_variable _cv;
-        std::optional<process_result> _result;
-        std::queue<std::unique_ptr<task>> _tasks;
+        std::atomic<int> _sleepers{ 0 };
+
+        // For a thread_pool's monitor, which sleeps while nothing is queued: once the hooks are armed, the next enqueue runs them all (once, on the enqueueing thread), so an idle queue needn't be polled. While they aren't armed, an enqueue only pays for loading the flag.
+        std::mutex _enque_hooks_mutex;
+        std::vector<std::pair<void const*, std::function<void()>>> _enque_hooks;
+        std::atomic<bool> _enque_hooks_armed{ false };
+
+        template<typename T>
+        static std::promise<T> make_promise()
+        {
+            return std::promise<T>{ std::allocator_arg, detail::pool_allocator<T>{} };
+        }
 
-        void enque_f(std::unique_ptr<task>&& t);
+        lane& lane_for(priority p);
+        void enque_f(detail::task&& t, priority p);
+        void enque_f(detail::task* tasks, std::size_t count, priority p);
+        detail::worker_counters& counters_for(worker* self);
+        bool try_pop(worker* self, detail::task& t);
+        void run(worker* self, detail::task& t);
+        bool try_pop_normal(worker* self, detail::task& t);
+        bool try_steal(worker* self, detail::task& t);
+        worker* claim_worker();
+        void release_worker(worker* w);
+        bool has_tasks() const;
+        bool park(std::chrono::steady_clock::duration timeout);
+        void wake(std::size_t count);
+        void add_enque_hook(void const* owner, std::function<void()> hook);
+        void remove_enque_hook(void const* owner);
+        void arm_enque_hooks();
+        void set_state(state s);
+        void drain();
     };
 }
@@ -0,0 +1,21 @@
+
+#pragma once
+
+#include <stdexcept>
+
+namespace dispatcher
+{
+    // The error a task's future gets when the task's deadline passed before a worker got to it (so it was dropped without running)
+    class task_timeout : public std::runtime_error
+    {
+    public:
+        task_timeout() : std::runtime_error{ "task deadline expired before it could run" } {}
+    };
+
+    // The error a task's future gets when the task was cancelled, or dropped because its queue was interrupted or destroyed, before it could run
+    class task_cancelled : public std::runtime_error
+    {
+    public:
+        task_cancelled() : std::runtime_error{ "task was cancelled before it could run" } {}
+    };
+}
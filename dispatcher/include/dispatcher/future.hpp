@@ -0,0 +1,390 @@
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dispatcher/dispatcher.hpp"
+#include "dispatcher/pool.hpp"
+#include "dispatcher/task.hpp"
+
+namespace dispatcher
+{
+    template<typename T>
+    class future;
+
+    namespace detail
+    {
+        // What a future<void> holds
+        struct nothing {};
+
+        template<typename T>
+        struct stored { using type = T; };
+
+        template<>
+        struct stored<void> { using type = nothing; };
+
+        // The state shared by a future (and all its copies) and whatever is going to complete it. Continuations registered before it completes are kept in a list, and run (by whichever thread completes it) as soon as it does; it doesn't need anyone blocked on it.
+        template<typename T>
+        class future_state
+        {
+        public:
+            using value_type = typename stored<T>::type;
+
+            explicit future_state(std::weak_ptr<task_queue> queue) : _queue{ std::move(queue) } {}
+
+            ~future_state()
+            {
+                if (_has_value) { value_ptr()->~value_type(); }
+            }
+
+            std::weak_ptr<task_queue> const& queue() const { return _queue; }
+
+            bool is_ready() const { return _ready.load(std::memory_order_acquire); }
+
+            template<typename... TArgs>
+            void set_value(TArgs&&... args)
+            {
+                std::unique_lock<std::mutex> guard{ _mutex };
+                new (&_value) value_type(std::forward<TArgs>(args)...);
+                _has_value = true;
+                complete(guard);
+            }
+
+            void set_exception(std::exception_ptr error)
+            {
+                std::unique_lock<std::mutex> guard{ _mutex };
+                _error = std::move(error);
+                complete(guard);
+            }
+
+            // Run the given task once this is ready (straight away, on this thread, if it already is; otherwise on the thread that completes it)
+            void on_ready(task continuation)
+            {
+                {
+                    std::unique_lock<std::mutex> guard{ _mutex };
+                    if (!_ready.load(std::memory_order_relaxed))
+                    {
+                        _continuations.push_back(std::move(continuation));
+                        return;
+                    }
+                }
+                continuation();
+            }
+
+            void wait()
+            {
+                if (is_ready()) { return; }
+                std::unique_lock<std::mutex> guard{ _mutex };
+                _cv.wait(guard, [this]() { return _ready.load(std::memory_order_relaxed); });
+            }
+
+            value_type const& get()
+            {
+                wait();
+                if (_error) { std::rethrow_exception(_error); }
+                return *value_ptr();
+            }
+
+        private:
+            void complete(std::unique_lock<std::mutex>& guard)
+            {
+                _ready.store(true, std::memory_order_release);
+                auto continuations = std::move(_continuations);
+                _cv.notify_all();
+                guard.unlock();
+                for (auto& continuation : continuations) { continuation(); }
+            }
+
+            value_type const* value_ptr() const { return reinterpret_cast<value_type const*>(&_value); }
+            value_type* value_ptr() { return reinterpret_cast<value_type*>(&_value); }
+
+            std::weak_ptr<task_queue> const _queue;
+            std::mutex _mutex;
+            std::condition_variable _cv;
+            std::atomic<bool> _ready{ false };
+            std::vector<task> _continuations;
+            std::exception_ptr _error;
+            bool _has_value = false;
+            std::aligned_storage_t<sizeof(value_type), alignof(value_type)> _value;
+        };
+
+        template<typename T>
+        std::shared_ptr<future_state<T>> make_future_state(std::weak_ptr<task_queue> queue)
+        {
+            return std::allocate_shared<future_state<T>>(pool_allocator<future_state<T>>{}, std::move(queue));
+        }
+
+        // The one thing that can complete a future. If it goes away without having done so (say, because the task holding it was dropped along with its queue), the future gets a task_cancelled error, so nothing waits on it forever.
+        template<typename T>
+        class future_setter
+        {
+        public:
+            explicit future_setter(std::shared_ptr<future_state<T>> state) : _state{ std::move(state) } {}
+            future_setter(future_setter&&) noexcept = default;
+            future_setter& operator=(future_setter&&) noexcept = default;
+
+            ~future_setter()
+            {
+                if (_state) { _state->set_exception(std::make_exception_ptr(task_cancelled{})); }
+            }
+
+            template<typename... TArgs>
+            void set_value(TArgs&&... args)
+            {
+                _state->set_value(std::forward<TArgs>(args)...);
+                _state.reset();
+            }
+
+            void set_exception(std::exception_ptr error)
+            {
+                _state->set_exception(std::move(error));
+                _state.reset();
+            }
+
+            // Complete with whatever the functor returns (or throws)
+            template<typename TFunctor>
+            void set_from(TFunctor& f, std::false_type /* returns void */)
+            {
+                try
+                {
+                    set_value(f());
+                }
+                catch (...)
+                {
+                    set_exception(std::current_exception());
+                }
+            }
+
+            template<typename TFunctor>
+            void set_from(TFunctor& f, std::true_type /* returns void */)
+            {
+                try
+                {
+                    f();
+                    set_value();
+                }
+                catch (...)
+                {
+                    set_exception(std::current_exception());
+                }
+            }
+
+        private:
+            std::shared_ptr<future_state<T>> _state;
+        };
+
+        // A task that runs a functor and completes a future with the result
+        template<typename T, typename TFunctor>
+        struct future_call
+        {
+            future_setter<T> setter;
+            TFunctor f;
+
+            void operator()() { setter.set_from(f, std::is_void<T>{}); }
+        };
+
+        // Calls a continuation with the future it was waiting on
+        template<typename T, typename TFunctor>
+        struct bound_continuation
+        {
+            future<T> source;
+            TFunctor f;
+
+            auto operator()() { return f(source); }
+        };
+
+        // Posts a task to a queue, if the queue is still around (if not, the task is dropped, and its future cancelled). A future that never had a queue at all (when_all or when_any of nothing) has nowhere to post to, so its continuations just run, on the thread that got here.
+        struct post_to
+        {
+            std::weak_ptr<task_queue> queue;
+            task t;
+
+            void operator()()
+            {
+                if (!queue.owner_before(std::weak_ptr<task_queue>{}) && !std::weak_ptr<task_queue>{}.owner_before(queue))
+                {
+                    t();
+                    return;
+                }
+                if (auto q = queue.lock()) { q->post(std::move(t)); }
+            }
+        };
+
+        template<typename T>
+        struct is_future : std::false_type {};
+
+        template<typename T>
+        struct is_future<future<T>> : std::true_type {};
+
+        // Lets the combinators below at a future's state
+        struct future_access
+        {
+            template<typename T>
+            static std::shared_ptr<future_state<T>> const& state(future<T> const& f) { return f._state; }
+        };
+    }
+
+    // A future result of work on a task_queue, which (unlike std::future) can be copied, and can have continuations attached with then(), so that work which depends on other work can be scheduled without any thread blocking while it waits
+    template<typename T>
+    class future
+    {
+    public:
+        using value_type = T;
+
+        future() = default;
+        explicit future(std::shared_ptr<detail::future_state<T>> state) : _state{ std::move(state) } {}
+
+        bool valid() const { return _state != nullptr; }
+        bool is_ready() const { return _state->is_ready(); }
+
+        // Block until the result is ready. (This is here for the edges of a program, where something finally has to wait; work on the queue itself should use then() instead.)
+        void wait() const { _state->wait(); }
+
+        // Wait for the result, and return it (or rethrow the error the work finished with)
+        decltype(auto) get() const { return get(std::is_void<T>{}); }
+
+        // Attach work to run once this is ready, with this future as its parameter (from which it can get the result, or the error). The work is posted to the queue this future's work ran on, as soon as it's ready, and its own result comes back as another future.
+        template<typename TFunctor>
+        auto then(TFunctor&& f) const
+        {
+            using functor = detail::bound_continuation<T, std::decay_t<TFunctor>>;
+            using result_type = decltype(std::declval<functor&>()());
+            auto state = detail::make_future_state<result_type>(_state->queue());
+            auto result = future<result_type>{ state };
+            _state->on_ready(detail::task{ detail::post_to{ _state->queue(), detail::task{ detail::future_call<result_type, functor>{ detail::future_setter<result_type>{ std::move(state) }, functor{ *this, std::forward<TFunctor>(f) } } } } });
+            return result;
+        }
+
+    private:
+        friend struct detail::future_access;
+
+        T const& get(std::false_type /* void */) const { return _state->get(); }
+        void get(std::true_type /* void */) const { _state->get(); }
+
+        std::shared_ptr<detail::future_state<T>> _state;
+    };
+
+    // Submit work to the queue, like enque, but get the result back as a dispatcher::future, for continuations
+    template<typename TFunctor>
+    auto task_queue::submit(TFunctor&& f) -> future<decltype(std::declval<std::decay_t<TFunctor>&>()())>
+    {
+        using result_type = decltype(std::declval<std::decay_t<TFunctor>&>()());
+        auto state = detail::make_future_state<result_type>(shared_from_this());
+        auto result = future<result_type>{ state };
+        post(detail::future_call<result_type, std::decay_t<TFunctor>>{ detail::future_setter<result_type>{ std::move(state) }, std::forward<TFunctor>(f) });
+        return result;
+    }
+
+    // A future that becomes ready when all the given futures are, holding them (all ready). It completes on whichever thread completes the last of them; nothing waits. (If there aren't any, it's ready straight away; with no queue to post continuations to, it runs them on the thread attaching them, as do futures from those.)
+    template<typename TIter, typename = std::enable_if_t<!detail::is_future<TIter>::value>>
+    auto when_all(TIter first, TIter last)
+    {
+        using input = typename std::iterator_traits<TIter>::value_type;
+        using result_type = std::vector<input>;
+        struct gather
+        {
+            gather(detail::future_setter<result_type> s, result_type i) : setter{ std::move(s) }, inputs{ std::move(i) }, remaining{ inputs.size() } {}
+            detail::future_setter<result_type> setter;
+            result_type inputs;
+            std::atomic<std::size_t> remaining;
+        };
+
+        result_type inputs(first, last);
+        auto state = detail::make_future_state<result_type>(inputs.empty() ? std::weak_ptr<task_queue>{} : detail::future_access::state(inputs.front())->queue());
+        auto result = future<result_type>{ state };
+        if (inputs.empty())
+        {
+            state->set_value();
+            return result;
+        }
+        auto g = std::make_shared<gather>(detail::future_setter<result_type>{ std::move(state) }, inputs);
+        for (auto const& f : inputs)
+        {
+            detail::future_access::state(f)->on_ready(detail::task{ [g]()
+            {
+                if (--g->remaining == 0) { g->setter.set_value(std::move(g->inputs)); }
+            }});
+        }
+        return result;
+    }
+
+    // The same for a fixed set of futures, of any types, held in a tuple
+    template<typename TFirst, typename... T>
+    auto when_all(future<TFirst> first, future<T>... rest)
+    {
+        using result_type = std::tuple<future<TFirst>, future<T>...>;
+        struct gather
+        {
+            gather(detail::future_setter<result_type> s, result_type i) : setter{ std::move(s) }, inputs{ std::move(i) }, remaining{ 1 + sizeof...(T) } {}
+            detail::future_setter<result_type> setter;
+            result_type inputs;
+            std::atomic<std::size_t> remaining;
+        };
+
+        auto state = detail::make_future_state<result_type>(detail::future_access::state(first)->queue());
+        auto result = future<result_type>{ state };
+        auto g = std::make_shared<gather>(detail::future_setter<result_type>{ std::move(state) }, result_type{ first, rest... });
+        auto on_ready = [&g](auto const& f)
+        {
+            detail::future_access::state(f)->on_ready(detail::task{ [g]()
+            {
+                if (--g->remaining == 0) { g->setter.set_value(std::move(g->inputs)); }
+            }});
+            return 0;
+        };
+        int expand[] = { on_ready(first), on_ready(rest)... };
+        (void)expand;
+        return result;
+    }
+
+    template<typename TSequence>
+    struct when_any_result
+    {
+        std::size_t index;
+        TSequence futures;
+    };
+
+    // A future that becomes ready as soon as any of the given futures is, holding them all, and the index of the one that was ready first. (If there aren't any, it's ready straight away, with an index of -1, and runs its continuations inline, as when_all does.)
+    template<typename TIter>
+    auto when_any(TIter first, TIter last)
+    {
+        using input = typename std::iterator_traits<TIter>::value_type;
+        using result_type = when_any_result<std::vector<input>>;
+        struct race
+        {
+            race(detail::future_setter<result_type> s, std::vector<input> i) : setter{ std::move(s) }, inputs{ std::move(i) } {}
+            detail::future_setter<result_type> setter;
+            std::vector<input> inputs;
+            std::atomic<bool> done{ false };
+        };
+
+        std::vector<input> inputs(first, last);
+        auto state = detail::make_future_state<result_type>(inputs.empty() ? std::weak_ptr<task_queue>{} : detail::future_access::state(inputs.front())->queue());
+        auto result = future<result_type>{ state };
+        if (inputs.empty())
+        {
+            state->set_value(result_type{ static_cast<std::size_t>(-1), {} });
+            return result;
+        }
+        auto r = std::make_shared<race>(detail::future_setter<result_type>{ std::move(state) }, inputs);
+        for (std::size_t i = 0; i < inputs.size(); ++i)
+        {
+            detail::future_access::state(inputs[i])->on_ready(detail::task{ [r, i]()
+            {
+                if (!r->done.exchange(true)) { r->setter.set_value(result_type{ i, std::move(r->inputs) }); }
+            }});
+        }
+        return result;
+    }
+}
@@ -0,0 +1,150 @@
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+namespace dispatcher
+{
+    // A histogram of durations in power-of-two buckets: bucket 0 counts zero-length durations, and bucket i (from 1) counts those of at least 2^(i-1) and under 2^i nanoseconds. The last bucket also takes everything longer (at 48 buckets, that's a couple of days).
+    struct histogram
+    {
+        static constexpr std::size_t bucket_count = 48;
+        std::array<std::uint64_t, bucket_count> buckets{};
+
+        std::uint64_t count() const;
+
+        // An upper bound for the given percentile (0 to 100): the top of the bucket it falls in
+        std::chrono::nanoseconds percentile(double p) const;
+
+        histogram& operator+=(histogram const& other);
+    };
+
+    // What one worker slot (or all threads without one) did, from when the queue was made
+    struct worker_metrics
+    {
+        std::uint64_t enqueued = 0;
+        std::uint64_t executed = 0;
+        std::uint64_t stolen = 0;
+        // How many times a thread in the slot ran out of work and went to sleep
+        std::uint64_t parked = 0;
+        // How many times a thread in the slot found its deque's lock (or the one it was stealing from) already taken
+        std::uint64_t contended = 0;
+        // From enqueue to starting to run, and running
+        histogram wait_time;
+        histogram run_time;
+
+        worker_metrics& operator+=(worker_metrics const& other);
+    };
+
+    struct metrics_snapshot
+    {
+        // Whether the queue was built to count anything (with DISPATCHER_METRICS); if not, only the depths are filled in
+        bool enabled = false;
+        std::chrono::steady_clock::time_point taken;
+
+        // Tasks waiting in each priority's shared queue, and on workers' own deques
+        std::size_t high_depth = 0;
+        std::size_t normal_depth = 0;
+        std::size_t low_depth = 0;
+        std::size_t local_depth = 0;
+
+        // Threads processing the queue have a slot each (reused as threads come and go); everything done by other threads (enqueueing, mostly) is counted together
+        std::vector<worker_metrics> workers;
+        worker_metrics external;
+        // How many times a shared queue's overflow lock was found already taken
+        std::uint64_t overflow_contended = 0;
+
+        std::size_t depth() const { return high_depth + normal_depth + low_depth + local_depth; }
+        worker_metrics total() const;
+    };
+
+    // One task run, for a trace
+    struct trace_event
+    {
+        std::size_t worker;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::nanoseconds duration;
+    };
+
+    void write_json(std::ostream& out, metrics_snapshot const& snapshot);
+
+    // In the Chrome trace event format (for chrome://tracing, or Perfetto), one row per worker slot
+    void write_chrome_trace(std::ostream& out, std::vector<trace_event> const& events);
+
+    namespace detail
+    {
+#ifdef DISPATCHER_METRICS
+        // The counters behind the snapshot. Each worker slot has its own, so recording doesn't contend with other threads (the atomics are only so a snapshot can read them while they're being written).
+        class counter
+        {
+        public:
+            void add(std::uint64_t n = 1) { _value.fetch_add(n, std::memory_order_relaxed); }
+            std::uint64_t load() const { return _value.load(std::memory_order_relaxed); }
+
+        private:
+            std::atomic<std::uint64_t> _value{ 0 };
+        };
+
+        class histogram_counter
+        {
+        public:
+            void record(std::chrono::nanoseconds duration)
+            {
+                auto ns = static_cast<std::uint64_t>(duration.count() > 0 ? duration.count() : 0);
+                _buckets[bucket(ns)].add();
+            }
+
+            histogram load() const;
+
+        private:
+            static std::size_t bucket(std::uint64_t ns)
+            {
+                if (ns == 0) { return 0; }
+#if defined(__GNUC__)
+                std::size_t width = 64 - __builtin_clzll(ns);
+#else
+                std::size_t width = 0;
+                while (ns != 0) { ++width; ns >>= 1; }
+#endif
+                return width < histogram::bucket_count ? width : histogram::bucket_count - 1;
+            }
+
+            std::array<counter, histogram::bucket_count> _buckets;
+        };
+#else
+        // Without DISPATCHER_METRICS, the counters count nothing, and compile away to nothing
+        class counter
+        {
+        public:
+            void add(std::uint64_t = 1) {}
+            std::uint64_t load() const { return 0; }
+        };
+
+        class histogram_counter
+        {
+        public:
+            void record(std::chrono::nanoseconds) {}
+            histogram load() const { return histogram{}; }
+        };
+#endif
+
+        struct worker_counters
+        {
+            counter enqueued;
+            counter executed;
+            counter stolen;
+            counter parked;
+            counter contended;
+            histogram_counter wait_time;
+            histogram_counter run_time;
+
+            worker_metrics load() const;
+        };
+    }
+}
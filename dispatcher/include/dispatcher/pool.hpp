@@ -0,0 +1,48 @@
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+namespace dispatcher
+{
+    namespace detail
+    {
+        // Small blocks (up to max_pooled_size bytes) come from per-thread free lists, one list per power-of-two size class, so a thread that keeps allocating and freeing blocks of the same size (as the queue does for every task) doesn't touch the heap at all once it has warmed up. A thread that frees more than it allocates hands blocks on to a shared list in batches, for threads that allocate more than they free to pick up. Larger blocks go straight to the heap, as do over-aligned ones.
+        constexpr std::size_t max_pooled_size = 256;
+
+        // Anything more strictly aligned than this (which operator new guarantees, before C++17) bypasses the pool, and gets a block of its own, aligned by hand
+        constexpr std::size_t max_pooled_alignment = alignof(std::max_align_t);
+
+        void* allocate_block(std::size_t size, std::size_t alignment = max_pooled_alignment);
+        void deallocate_block(void* p, std::size_t size, std::size_t alignment = max_pooled_alignment) noexcept;
+
+        // A standard allocator over the block pool, for anything that takes one (std::promise does, for its shared state and its result)
+        template<typename T>
+        class pool_allocator
+        {
+        public:
+            using value_type = T;
+
+            pool_allocator() = default;
+            template<typename U>
+            pool_allocator(pool_allocator<U> const&) {}
+
+            T* allocate(std::size_t n)
+            {
+                return static_cast<T*>(allocate_block(n * sizeof(T), alignof(T)));
+            }
+
+            void deallocate(T* p, std::size_t n) noexcept
+            {
+                deallocate_block(p, n * sizeof(T), alignof(T));
+            }
+        };
+
+        template<typename T, typename U>
+        bool operator==(pool_allocator<T> const&, pool_allocator<U> const&) { return true; }
+
+        template<typename T, typename U>
+        bool operator!=(pool_allocator<T> const&, pool_allocator<U> const&) { return false; }
+    }
+}
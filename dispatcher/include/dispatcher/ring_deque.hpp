@@ -0,0 +1,75 @@
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace dispatcher
+{
+    namespace detail
+    {
+        // A double-ended queue in one circular buffer, which doubles when it fills up and never shrinks, so once it has grown to its working size, pushing and popping at either end never allocates (unlike std::deque, which allocates and frees blocks as it goes)
+        template<typename T>
+        class ring_deque
+        {
+        public:
+            ring_deque() = default;
+            explicit ring_deque(std::size_t capacity) { reserve(capacity); }
+
+            bool empty() const { return _size == 0; }
+            std::size_t size() const { return _size; }
+
+            T& front() { return _items[_first]; }
+            T& back() { return _items[index(_size - 1)]; }
+
+            void push_back(T&& value)
+            {
+                reserve(_size + 1);
+                _items[index(_size)] = std::move(value);
+                ++_size;
+            }
+
+            void push_front(T&& value)
+            {
+                reserve(_size + 1);
+                _first = (_first + _capacity - 1) & (_capacity - 1);
+                _items[_first] = std::move(value);
+                ++_size;
+            }
+
+            void pop_back()
+            {
+                _items[index(_size - 1)] = T{};
+                --_size;
+            }
+
+            void pop_front()
+            {
+                _items[_first] = T{};
+                _first = (_first + 1) & (_capacity - 1);
+                --_size;
+            }
+
+        private:
+            std::size_t index(std::size_t i) const { return (_first + i) & (_capacity - 1); }
+
+            void reserve(std::size_t size)
+            {
+                if (size <= _capacity) { return; }
+                std::size_t capacity = _capacity ? _capacity * 2 : 16;
+                while (capacity < size) { capacity *= 2; }
+                std::unique_ptr<T[]> items{ new T[capacity] };
+                for (std::size_t i = 0; i < _size; ++i) { items[i] = std::move(_items[index(i)]); }
+                _items = std::move(items);
+                _capacity = capacity;
+                _first = 0;
+            }
+
+            std::unique_ptr<T[]> _items;
+            std::size_t _capacity = 0;
+            std::size_t _first = 0;
+            std::size_t _size = 0;
+        };
+    }
+}
@@ -0,0 +1,325 @@
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "dispatcher/errors.hpp"
+#include "dispatcher/pool.hpp"
+
+namespace dispatcher
+{
+    namespace detail
+    {
+        // A move-only, type-erased, parameterless callable, for the queue to hold its tasks in. Callables small enough (and cheap enough to move) are stored inline, so they don't allocate at all; bigger ones are stored in a block from the pool.
+        class task
+        {
+        public:
+            static constexpr std::size_t inline_size = 56;
+
+            task() = default;
+
+            template<typename TFunctor, typename = std::enable_if_t<!std::is_same<std::decay_t<TFunctor>, task>::value>>
+            task(TFunctor&& f)
+            {
+                using functor = std::decay_t<TFunctor>;
+                store<functor>(std::forward<TFunctor>(f), std::integral_constant<bool, fits_inline<functor>()>{});
+            }
+
+            task(task&& other) noexcept { take(other); }
+
+            task& operator=(task&& other) noexcept
+            {
+                if (this != &other)
+                {
+                    reset();
+                    take(other);
+                }
+                return *this;
+            }
+
+            task(task const&) = delete;
+            task& operator=(task const&) = delete;
+
+            ~task() { reset(); }
+
+            explicit operator bool() const { return _ops != nullptr; }
+
+            // Tasks aren't expected to throw (enque catches everything for the future); if one does anyway, that's the end of the program, as it would be for a thread
+            void operator()() noexcept { _ops->invoke(_storage); }
+
+#ifdef DISPATCHER_METRICS
+            // When the task was enqueued, for measuring how long it waited
+            std::chrono::steady_clock::time_point enqueued;
+#endif
+
+            void reset() noexcept
+            {
+                if (_ops)
+                {
+                    _ops->destroy(_storage);
+                    _ops = nullptr;
+                }
+            }
+
+        private:
+            struct operations
+            {
+                void (*invoke)(void* storage);
+                void (*move)(void* from, void* to) noexcept;
+                void (*destroy)(void* storage) noexcept;
+            };
+
+            template<typename TFunctor>
+            static constexpr bool fits_inline()
+            {
+                return sizeof(TFunctor) <= inline_size && alignof(TFunctor) <= alignof(void*) && std::is_nothrow_move_constructible<TFunctor>::value;
+            }
+
+            // Stored in place
+            template<typename TFunctor>
+            struct inline_operations
+            {
+                static void invoke(void* storage) { (*static_cast<TFunctor*>(storage))(); }
+                static void move(void* from, void* to) noexcept
+                {
+                    new (to) TFunctor(std::move(*static_cast<TFunctor*>(from)));
+                    static_cast<TFunctor*>(from)->~TFunctor();
+                }
+                static void destroy(void* storage) noexcept { static_cast<TFunctor*>(storage)->~TFunctor(); }
+                static constexpr operations table{ &invoke, &move, &destroy };
+            };
+
+            // Stored in a pool block, with the pointer in place
+            template<typename TFunctor>
+            struct pooled_operations
+            {
+                static TFunctor*& get(void* storage) { return *static_cast<TFunctor**>(storage); }
+                static void invoke(void* storage) { (*get(storage))(); }
+                static void move(void* from, void* to) noexcept { new (to) TFunctor*{ get(from) }; }
+                static void destroy(void* storage) noexcept
+                {
+                    get(storage)->~TFunctor();
+                    deallocate_block(get(storage), sizeof(TFunctor), alignof(TFunctor));
+                }
+                static constexpr operations table{ &invoke, &move, &destroy };
+            };
+
+            template<typename TFunctor, typename TArg>
+            void store(TArg&& f, std::true_type)
+            {
+                new (_storage) TFunctor(std::forward<TArg>(f));
+                _ops = &inline_operations<TFunctor>::table;
+            }
+
+            template<typename TFunctor, typename TArg>
+            void store(TArg&& f, std::false_type)
+            {
+                auto block = allocate_block(sizeof(TFunctor), alignof(TFunctor));
+                try
+                {
+                    new (_storage) TFunctor*{ new (block) TFunctor(std::forward<TArg>(f)) };
+                }
+                catch (...)
+                {
+                    deallocate_block(block, sizeof(TFunctor), alignof(TFunctor));
+                    throw;
+                }
+                _ops = &pooled_operations<TFunctor>::table;
+            }
+
+            void take(task& other) noexcept
+            {
+                if (other._ops)
+                {
+                    other._ops->move(other._storage, _storage);
+                    _ops = other._ops;
+                    other._ops = nullptr;
+#ifdef DISPATCHER_METRICS
+                    enqueued = other.enqueued;
+#endif
+                }
+            }
+
+            alignas(void*) unsigned char _storage[inline_size];
+            operations const* _ops = nullptr;
+        };
+
+        template<typename TFunctor>
+        constexpr task::operations task::inline_operations<TFunctor>::table;
+
+        template<typename TFunctor>
+        constexpr task::operations task::pooled_operations<TFunctor>::table;
+
+        // The coroutine (if any) whose await_suspend is running on this thread, and whether its resumption has been dropped while it was
+        struct suspension
+        {
+            void const* coroutine;
+            bool dropped;
+        };
+
+        inline suspension& current_suspension()
+        {
+            static thread_local suspension current{ nullptr, false };
+            return current;
+        }
+
+        // Marks a coroutine as in the middle of suspending, for as long as its await_suspend is handing over its resumption. If the resumption is dropped on this thread in that time (the queue was interrupted just as it went in), it doesn't resume the coroutine from under its own await_suspend; instead, dropped() says so, and await_suspend returns false, so the coroutine carries on straight away.
+        class suspending_scope
+        {
+        public:
+            explicit suspending_scope(void const* coroutine) noexcept : _previous{ current_suspension() } { current_suspension() = suspension{ coroutine, false }; }
+            ~suspending_scope() { current_suspension() = _previous; }
+
+            suspending_scope(suspending_scope const&) = delete;
+            suspending_scope& operator=(suspending_scope const&) = delete;
+
+            bool dropped() const noexcept { return current_suspension().dropped; }
+
+        private:
+            suspension _previous;
+        };
+
+        // Resumes a suspended coroutine, when run. If it's dropped without being run (because the queue holding it was interrupted or destroyed first), it resumes the coroutine anyway, with the awaiter's cancelled flag set, so the co_await throws task_cancelled instead of leaving the coroutine suspended for ever, and whatever awaits it waiting for ever. (Unless the coroutine is still in its await_suspend, on this thread: see suspending_scope.)
+        template<typename THandle>
+        class resumption
+        {
+        public:
+            resumption(THandle handle, bool& cancelled) noexcept : _handle{ handle }, _cancelled{ &cancelled } {}
+
+            resumption(resumption&& other) noexcept : _handle{ other._handle }, _cancelled{ std::exchange(other._cancelled, nullptr) } {}
+
+            resumption& operator=(resumption&&) = delete;
+
+            ~resumption()
+            {
+                if (!_cancelled) { return; }
+                *_cancelled = true;
+                auto& suspending = current_suspension();
+                if (suspending.coroutine == _handle.address())
+                {
+                    suspending.dropped = true;
+                    return;
+                }
+                _handle.resume();
+            }
+
+            void operator()()
+            {
+                _cancelled = nullptr;
+                _handle.resume();
+            }
+
+        private:
+            THandle _handle;
+            bool* _cancelled;
+        };
+
+        // A promise that, if it's dropped without being kept (because the task holding it was cancelled, or dropped when its queue was interrupted or destroyed), completes its future with task_cancelled, rather than the broken_promise a plain std::promise would leave
+        template<typename T>
+        class cancelling_promise
+        {
+        public:
+            cancelling_promise(std::promise<T>&& promise) noexcept : _promise{ std::move(promise) }, _pending{ true } {}
+
+            cancelling_promise(cancelling_promise&& other) noexcept : _promise{ std::move(other._promise) }, _pending{ other._pending }
+            {
+                other._pending = false;
+            }
+
+            cancelling_promise& operator=(cancelling_promise&&) = delete;
+
+            ~cancelling_promise()
+            {
+                if (!_pending) { return; }
+                try
+                {
+                    _promise.set_exception(std::make_exception_ptr(task_cancelled{}));
+                }
+                catch (...)
+                {
+                }
+            }
+
+            template<typename... TArgs>
+            void set_value(TArgs&&... args)
+            {
+                _pending = false;
+                _promise.set_value(std::forward<TArgs>(args)...);
+            }
+
+            void set_exception(std::exception_ptr error)
+            {
+                _pending = false;
+                _promise.set_exception(std::move(error));
+            }
+
+        private:
+            std::promise<T> _promise;
+            bool _pending;
+        };
+
+        // A task that runs a functor and passes whatever it returns (or throws) on to a promise
+        template<typename T, typename TFunctor>
+        struct promised_call
+        {
+            cancelling_promise<T> promise;
+            TFunctor f;
+
+            void operator()()
+            {
+                try
+                {
+                    promise.set_value(f());
+                }
+                catch (...)
+                {
+                    promise.set_exception(std::current_exception());
+                }
+            }
+        };
+
+        template<typename TFunctor>
+        struct promised_call<void, TFunctor>
+        {
+            cancelling_promise<void> promise;
+            TFunctor f;
+
+            void operator()()
+            {
+                try
+                {
+                    f();
+                    promise.set_value();
+                }
+                catch (...)
+                {
+                    promise.set_exception(std::current_exception());
+                }
+            }
+        };
+
+        // A task that's only worth running before its deadline: after that, it's dropped, and its future gets a task_timeout error instead. (Which happens when a worker gets to it; there's no timer.)
+        template<typename T, typename TFunctor>
+        struct deadline_call
+        {
+            promised_call<T, TFunctor> call;
+            std::chrono::steady_clock::time_point deadline;
+
+            void operator()()
+            {
+                if (std::chrono::steady_clock::now() > deadline)
+                {
+                    call.promise.set_exception(std::make_exception_ptr(task_timeout{}));
+                    return;
+                }
+                call();
+            }
+        };
+    }
+}
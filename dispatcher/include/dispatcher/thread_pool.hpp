@@ -0,0 +1,79 @@
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "dispatcher/dispatcher.hpp"
+
+namespace dispatcher
+{
+    struct pool_options
+    {
+        // The pool never has fewer threads than this (they start with the pool), nor more than the maximum (which must be at least one, and no less than the minimum, or the pool's constructor throws std::invalid_argument)
+        unsigned min_threads = 1;
+        unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+        // The pool adds a thread when there are more than this many tasks waiting for each thread it has, and a thread (above the minimum) leaves once it has had nothing to do for the idle timeout
+        std::size_t tasks_per_thread = 64;
+        std::chrono::steady_clock::duration idle_timeout = std::chrono::milliseconds{ 100 };
+
+        // How often the pool looks at the queue depth to decide whether to grow, while there's work waiting (with nothing queued, or no room to grow, it doesn't look until something is enqueued, or a thread leaves)
+        std::chrono::steady_clock::duration monitor_interval = std::chrono::milliseconds{ 2 };
+
+        // Pinning (Linux only; ignored elsewhere). Given CPUs, each new thread is pinned to the next one in turn; given a NUMA node instead, every thread is pinned to that node's CPUs (those of them the process may run on). The pool's constructor throws std::invalid_argument for a CPU out of range or outside the process's affinity, or a node with no such CPUs.
+        std::vector<int> cpus;
+        int numa_node = -1;
+    };
+
+    // A pool of threads processing a task queue, which it owns and joins (unlike process_on_new_thread, whose threads are detached). It starts with the minimum number of threads, and adds and retires threads between the minimum and maximum as the queue depth goes up and down. The threads are started from the pool's own monitor thread, so the cost of creating them never lands on whoever is enqueueing work.
+    // The queue can still be finished or interrupted directly, and the pool's threads stop just as any other processing thread would; join() (or destruction) finishes the queue itself, and waits for every thread to stop.
+    class thread_pool
+    {
+    public:
+        explicit thread_pool(std::shared_ptr<task_queue> queue, pool_options options = pool_options{});
+        ~thread_pool();
+
+        thread_pool(thread_pool const&) = delete;
+        thread_pool& operator=(thread_pool const&) = delete;
+
+        std::shared_ptr<task_queue> const& queue() const { return _queue; }
+
+        // How many threads are running right now
+        std::size_t size() const;
+
+        // How many threads couldn't be pinned to their CPUs (and so ran unpinned), which can only happen if the process's affinity has changed since the pool was made
+        std::size_t pin_failures() const;
+
+        // Finish the queue, and wait for all work to be done and every thread to stop. (Returns interrupted if the queue was interrupted before the work was done.) Once joined, the pool can't be restarted.
+        task_queue::process_result join();
+
+    private:
+        void start_thread();
+        void run(std::vector<int> cpus);
+        void monitor();
+        void reap();
+
+        std::shared_ptr<task_queue> const _queue;
+        pool_options const _options;
+        std::vector<int> _node_cpus;
+
+        mutable std::mutex _mutex;
+        std::condition_variable _cv;
+        std::vector<std::thread> _threads;
+        std::vector<std::thread::id> _exited;
+        std::size_t _running = 0;
+        std::size_t _started = 0;
+        std::size_t _pin_failures = 0;
+        // Set once the queue is done, so no more threads are to be started
+        bool _stopping = false;
+        bool _interrupted = false;
+        std::thread _monitor;
+    };
+}
@@ -0,0 +1,74 @@
+
+#include "dispatcher/cancellation.hpp"
+#include "dispatcher/dispatcher.hpp"
+
+#include <algorithm>
+
+namespace dispatcher
+{
+    namespace
+    {
+        // The token of the task running on this thread, if it was enqueued with one
+        thread_local cancellation_token const* current_token = nullptr;
+    }
+
+    namespace detail
+    {
+        bool cancellation_state::add(std::weak_ptr<cancellable> c)
+        {
+            {
+                std::unique_lock<std::mutex> guard{ _mutex };
+                if (!_cancelled.load(std::memory_order_relaxed))
+                {
+                    if (_registered.size() >= _prune_size)
+                    {
+                        _registered.erase(std::remove_if(_registered.begin(), _registered.end(), [](std::weak_ptr<cancellable> const& r) { return r.expired(); }), _registered.end());
+                        _prune_size = std::max<std::size_t>(16, 2 * _registered.size());
+                    }
+                    _registered.push_back(std::move(c));
+                    return true;
+                }
+            }
+            if (auto registered = c.lock()) { registered->cancel(); }
+            return false;
+        }
+
+        // The cancellations happen outside the lock: each completes a future, which may run continuations that enqueue more work with the same token
+        void cancellation_state::cancel()
+        {
+            std::vector<std::weak_ptr<cancellable>> registered;
+            {
+                std::unique_lock<std::mutex> guard{ _mutex };
+                if (_cancelled.exchange(true, std::memory_order_acq_rel)) { return; }
+                registered.swap(_registered);
+            }
+            for (auto& r : registered)
+            {
+                if (auto c = r.lock()) { c->cancel(); }
+            }
+        }
+
+        cancellation_token const* exchange_current_token(cancellation_token const* token) noexcept
+        {
+            auto previous = current_token;
+            current_token = token;
+            return previous;
+        }
+    }
+
+    namespace this_task
+    {
+        bool stop_requested()
+        {
+            if (current_token && current_token->stop_requested()) { return true; }
+            auto queue = task_queue::_current.queue;
+            return queue && queue->_state.load(std::memory_order_relaxed) == task_queue::interrupting;
+        }
+
+        cancellation_token const& token()
+        {
+            static cancellation_token const never;
+            return current_token ? *current_token : never;
+        }
+    }
+}
@@ -1,36 +1,126 @@
 
 #include "dispatcher/dispatcher.hpp"
 
-#include <cassert>
+#include <algorithm>
+#include <thread>
 
 namespace dispatcher
 {
+    constexpr std::size_t task_queue::default_capacity;
+    constexpr std::size_t task_queue::max_workers;
+    constexpr std::size_t task_queue::batch_size;
+    constexpr std::size_t task_queue::external_shards;
+
+    thread_local task_queue::worker_context task_queue::_current{ nullptr, nullptr };
+
+    namespace
+    {
+        // The count of tasks taken, for threads processing without a deque of their own
+        thread_local unsigned unregistered_picks = 0;
+
+#ifdef DISPATCHER_METRICS
+        // Which of a queue's external counter sets this thread counts in (the same on every queue), handed out in turn
+        std::size_t external_index()
+        {
+            static std::atomic<std::size_t> next{ 0 };
+            static thread_local std::size_t index = next.fetch_add(1, std::memory_order_relaxed);
+            return index;
+        }
+#endif
+
+        // Take a lock, counting it if another thread has it already
+        std::unique_lock<std::mutex> lock_counted(std::mutex& mutex, detail::counter& contended)
+        {
+#ifdef DISPATCHER_METRICS
+            std::unique_lock<std::mutex> guard{ mutex, std::try_to_lock };
+            if (!guard)
+            {
+                contended.add();
+                guard.lock();
+            }
+            return guard;
+#else
+            (void)contended;
+            return std::unique_lock<std::mutex>{ mutex };
+#endif
+        }
+    }
+
+    task_queue::~task_queue()
+    {
+        set_state(interrupting);
+        drain();
+    }
+
     task_queue::process_result task_queue::process()
     {
+        return process(std::chrono::steady_clock::duration::max());
+    }
+
+    task_queue::process_result task_queue::process(std::chrono::steady_clock::duration idle_timeout)
+    {
+        // Processing can nest (a task can process another queue), so put back whatever this thread was doing before
+        auto self = claim_worker();
+        auto previous = _current;
+        _current = worker_context{ this, self };
+        auto result = process_result::finished;
         while(true)
         {
-            std::unique_ptr<task> t;
+            // Read the state before looking for work: if it says we're finishing and there's still no work after that, there never will be
+            auto s = _state.load(std::memory_order_acquire);
+            if (s == interrupting)
             {
-                std::unique_lock<std::mutex> guard{ _mutex };
-                while (_tasks.empty() && !_result)
-                {
-                    _cv.wait(guard);
-                }
-                if (_result == process_result::interrupted) { return process_result::interrupted; }
-                if (!_tasks.empty())
-                {
-                    t = std::move(_tasks.front());
-                    _tasks.pop();
-                }
-                else
+                result = process_result::interrupted;
+                break;
+            }
+            detail::task t;
+            if (try_pop(self, t))
+            {
+                // The queue may have been interrupted while the task was being taken (after the state was read above), in which case the task is dropped with everything else
+                if (_state.load(std::memory_order_seq_cst) == interrupting)
                 {
-                    assert(_result == process_result::finished);
-                    return process_result::finished;
+                    t.reset();
+                    drain();
+                    result = process_result::interrupted;
+                    break;
                 }
+                run(self, t);
+                continue;
+            }
+            if (s == finishing) { break; }
+            if (!park(idle_timeout))
+            {
+                result = process_result::idle;
+                break;
             }
-            assert(t);
-            (*t)();
         }
+        _current = previous;
+        release_worker(self);
+        return result;
+    }
+
+    void task_queue::run(worker* self, detail::task& t)
+    {
+#ifdef DISPATCHER_METRICS
+        // A worker going straight from one task to the next takes the end of the last one as the start of this one (counting the moment spent taking it from the queue as waiting), which saves reading the clock a third time per task
+        auto& counters = counters_for(self);
+        auto start = self && self->last_finish != std::chrono::steady_clock::time_point{} ? self->last_finish : std::chrono::steady_clock::now();
+        counters.wait_time.record(start - t.enqueued);
+        t();
+        auto finish = std::chrono::steady_clock::now();
+        auto duration = finish - start;
+        if (self) { self->last_finish = finish; }
+        counters.run_time.record(duration);
+        counters.executed.add();
+        if (self && _tracing.load(std::memory_order_relaxed))
+        {
+            std::unique_lock<std::mutex> guard{ self->trace_mutex };
+            self->trace.push_back(trace_event{ static_cast<std::size_t>(self - _workers.get()), start, duration });
+        }
+#else
+        (void)self;
+        t();
+#endif
     }
 
     std::future<task_queue::process_result> task_queue::process_on_new_thread()
@@ -47,22 +137,390 @@ namespace dispatcher
 
     void task_queue::finish()
     {
-        std::unique_lock<std::mutex> guard{ _mutex };
-        _result = process_result::finished;
-        _cv.notify_all();
+        set_state(finishing);
     }
 
     void task_queue::interrupt()
     {
+        set_state(interrupting);
+        drain();
+    }
+
+    // Drop everything queued, once the queue has been interrupted. Dropping a task completes its future with task_cancelled, which may run continuations which enqueue more (and so come back here); so no lock is held while a task is destroyed.
+    void task_queue::drain()
+    {
+        detail::task t;
+        while (_high.try_pop(t) || _normal.try_pop(t) || _low.try_pop(t)) { t.reset(); }
+        auto count = _worker_count.load(std::memory_order_acquire);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto& w = _workers[i];
+            while (w.size.load(std::memory_order_acquire) != 0)
+            {
+                {
+                    std::unique_lock<std::mutex> guard{ w.mutex };
+                    if (w.tasks.empty()) { break; }
+                    t = std::move(w.tasks.front());
+                    w.tasks.pop_front();
+                    w.size.fetch_sub(1, std::memory_order_relaxed);
+                }
+                t.reset();
+            }
+        }
+    }
+
+    // The state only ever moves forward, so finishing a queue that's already been interrupted (as a pool does when it's joined) leaves it interrupted
+    void task_queue::set_state(state s)
+    {
+        auto current = _state.load(std::memory_order_seq_cst);
+        while (current < s && !_state.compare_exchange_weak(current, s, std::memory_order_seq_cst)) {}
         std::unique_lock<std::mutex> guard{ _mutex };
-        _result = process_result::interrupted;
         _cv.notify_all();
     }
 
-    void task_queue::enque_f(std::unique_ptr<task>&& t)
+    void task_queue::lane::push(detail::task* tasks, std::size_t count)
+    {
+        std::size_t pushed = 0;
+        if (_overflow_size.load(std::memory_order_acquire) == 0)
+        {
+            while (pushed < count && _ring.try_push(tasks[pushed])) { ++pushed; }
+        }
+        if (pushed < count)
+        {
+            auto guard = lock_counted(_overflow_mutex, contended);
+            for (auto i = pushed; i < count; ++i) { _overflow.push_back(std::move(tasks[i])); }
+            _overflow_size.fetch_add(count - pushed, std::memory_order_release);
+        }
+    }
+
+    bool task_queue::lane::try_pop(detail::task& t)
+    {
+        return try_pop_bulk(1, [&t](detail::task&& next) { t = std::move(next); }) != 0;
+    }
+
+    template<typename TFunctor>
+    std::size_t task_queue::lane::try_pop_bulk(std::size_t max, TFunctor&& f)
+    {
+        auto count = _ring.try_pop_bulk(max, f);
+        if (count != 0 || _overflow_size.load(std::memory_order_acquire) == 0) { return count; }
+        auto guard = lock_counted(_overflow_mutex, contended);
+        while (count < max && !_overflow.empty())
+        {
+            f(std::move(_overflow.front()));
+            _overflow.pop_front();
+            ++count;
+        }
+        _overflow_size.fetch_sub(count, std::memory_order_release);
+        return count;
+    }
+
+    bool task_queue::lane::empty() const
+    {
+        return _ring.empty() && _overflow_size.load(std::memory_order_seq_cst) == 0;
+    }
+
+    std::size_t task_queue::lane::size() const
+    {
+        return _ring.size() + _overflow_size.load(std::memory_order_relaxed);
+    }
+
+    std::size_t task_queue::size() const
+    {
+        auto size = _high.size() + _normal.size() + _low.size();
+        auto count = _worker_count.load(std::memory_order_acquire);
+        for (std::size_t i = 0; i < count; ++i) { size += _workers[i].size.load(std::memory_order_relaxed); }
+        return size;
+    }
+
+    metrics_snapshot task_queue::metrics() const
+    {
+        metrics_snapshot snapshot;
+#ifdef DISPATCHER_METRICS
+        snapshot.enabled = true;
+#endif
+        snapshot.taken = std::chrono::steady_clock::now();
+        snapshot.high_depth = _high.size();
+        snapshot.normal_depth = _normal.size();
+        snapshot.low_depth = _low.size();
+        auto count = _worker_count.load(std::memory_order_acquire);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            snapshot.local_depth += _workers[i].size.load(std::memory_order_relaxed);
+            snapshot.workers.push_back(_workers[i].counters.load());
+        }
+        for (auto const& external : _external) { snapshot.external += external.counters.load(); }
+        snapshot.overflow_contended = _high.contended.load() + _normal.contended.load() + _low.contended.load();
+        return snapshot;
+    }
+
+    void task_queue::start_trace()
+    {
+#ifdef DISPATCHER_METRICS
+        _tracing.store(true, std::memory_order_relaxed);
+#endif
+    }
+
+    std::vector<trace_event> task_queue::stop_trace()
+    {
+        std::vector<trace_event> events;
+#ifdef DISPATCHER_METRICS
+        _tracing.store(false, std::memory_order_relaxed);
+        auto count = _worker_count.load(std::memory_order_acquire);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            std::unique_lock<std::mutex> guard{ _workers[i].trace_mutex };
+            events.insert(events.end(), _workers[i].trace.begin(), _workers[i].trace.end());
+            _workers[i].trace.clear();
+        }
+#endif
+        return events;
+    }
+
+    detail::worker_counters& task_queue::counters_for(worker* self)
+    {
+#ifdef DISPATCHER_METRICS
+        return self ? self->counters : _external[external_index() % external_shards].counters;
+#else
+        // Nothing's counted, so there's no need to find this thread's set
+        return self ? self->counters : _external[0].counters;
+#endif
+    }
+
+    task_queue::lane& task_queue::lane_for(priority p)
+    {
+        switch (p)
+        {
+        case priority::high: return _high;
+        case priority::low: return _low;
+        default: return _normal;
+        }
+    }
+
+    void task_queue::enque_f(detail::task&& t, priority p)
+    {
+        enque_f(&t, 1, p);
+    }
+
+    // Normal priority tasks enqueued from inside a task stay on the running thread's own deque; everything else goes to the shared queue for its priority
+    void task_queue::enque_f(detail::task* tasks, std::size_t count, priority p)
+    {
+        if (count == 0) { return; }
+        auto self = _current.queue == this ? _current.self : nullptr;
+        auto& counters = counters_for(self);
+        counters.enqueued.add(count);
+#ifdef DISPATCHER_METRICS
+        auto now = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < count; ++i) { tasks[i].enqueued = now; }
+#endif
+        if (p == priority::normal && self)
+        {
+            auto guard = lock_counted(self->mutex, counters.contended);
+            for (std::size_t i = 0; i < count; ++i) { self->tasks.push_back(std::move(tasks[i])); }
+            self->size.fetch_add(count, std::memory_order_seq_cst);
+        }
+        else
+        {
+            lane_for(p).push(tasks, count);
+        }
+        wake(count);
+        // (wake() has fenced after publishing the task, so either this sees the hooks armed, or whoever armed them sees the task)
+        if (_enque_hooks_armed.load(std::memory_order_seq_cst) && _enque_hooks_armed.exchange(false, std::memory_order_seq_cst))
+        {
+            std::unique_lock<std::mutex> guard{ _enque_hooks_mutex };
+            for (auto const& hook : _enque_hooks) { hook.second(); }
+        }
+        // A task enqueued after the queue was interrupted is dropped straight away. (wake() has fenced after publishing the task, so if this doesn't see the interruption, interrupt()'s drain will see the task.)
+        if (_state.load(std::memory_order_seq_cst) == interrupting) { drain(); }
+    }
+
+    // A fixed ratio of picks (see priority), rather than aging by wait time
+    bool task_queue::try_pop(worker* self, detail::task& t)
     {
+        auto pick = ++(self ? self->picks : unregistered_picks);
+        if (pick % 16 == 0)
+        {
+            if (_low.try_pop(t) || try_pop_normal(self, t) || _high.try_pop(t)) { return true; }
+        }
+        else if (pick % 4 == 0)
+        {
+            if (try_pop_normal(self, t) || _high.try_pop(t) || _low.try_pop(t)) { return true; }
+        }
+        else
+        {
+            if (_high.try_pop(t) || try_pop_normal(self, t) || _low.try_pop(t)) { return true; }
+        }
+        return try_steal(self, t);
+    }
+
+    // Normal priority work: first this thread's own deque, newest first; then a batch from the shared queue. Of the batch, the oldest task goes straight to t, and the rest onto this thread's (empty) deque, arranged so it takes them oldest first.
+    bool task_queue::try_pop_normal(worker* self, detail::task& t)
+    {
+        if (!self) { return _normal.try_pop(t); }
+        if (self->size.load(std::memory_order_relaxed) != 0)
+        {
+            auto guard = lock_counted(self->mutex, self->counters.contended);
+            if (!self->tasks.empty())
+            {
+                t = std::move(self->tasks.back());
+                self->tasks.pop_back();
+                self->size.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        std::size_t count = 0;
+        auto guard = lock_counted(self->mutex, self->counters.contended);
+        _normal.try_pop_bulk(batch_size, [&](detail::task&& next)
+        {
+            if (count++ == 0) { t = std::move(next); }
+            else { self->tasks.push_front(std::move(next)); }
+        });
+        if (count > 1)
+        {
+            self->size.fetch_add(count - 1, std::memory_order_seq_cst);
+            guard.unlock();
+            // The rest of the batch can be stolen from here, by threads which may have parked while it was on its way
+            wake(count - 1);
+        }
+        return count != 0;
+    }
+
+    // Steal the oldest half of another thread's deque (up to a batch; or just one task, for a thread without a deque to keep the rest on). Start from the slot after the thief's own, so thieves spread out over their victims.
+    bool task_queue::try_steal(worker* self, detail::task& t)
+    {
+        detail::task stolen[batch_size];
+        std::size_t count = 0;
+        auto worker_count = _worker_count.load(std::memory_order_acquire);
+        auto start = self ? static_cast<std::size_t>(self - _workers.get()) + 1 : 0;
+        for (std::size_t i = 0; i < worker_count && count == 0; ++i)
+        {
+            auto& victim = _workers[(start + i) % worker_count];
+            if (&victim == self || victim.size.load(std::memory_order_relaxed) == 0) { continue; }
+            auto guard = lock_counted(victim.mutex, counters_for(self).contended);
+            auto wanted = self ? std::min(batch_size, (victim.tasks.size() + 1) / 2) : std::min<std::size_t>(1, victim.tasks.size());
+            for (; count < wanted; ++count)
+            {
+                stolen[count] = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+            }
+            victim.size.fetch_sub(count, std::memory_order_relaxed);
+        }
+        if (count == 0) { return false; }
+        counters_for(self).stolen.add(count);
+        t = std::move(stolen[0]);
+        if (count > 1)
+        {
+            auto guard = lock_counted(self->mutex, self->counters.contended);
+            for (std::size_t i = 1; i < count; ++i) { self->tasks.push_front(std::move(stolen[i])); }
+            self->size.fetch_add(count - 1, std::memory_order_seq_cst);
+            guard.unlock();
+            wake(count - 1);
+        }
+        return true;
+    }
+
+    task_queue::worker* task_queue::claim_worker()
+    {
+        for (std::size_t i = 0; i < max_workers; ++i)
+        {
+            if (!_workers[i].claimed.exchange(true, std::memory_order_acquire))
+            {
+                auto count = _worker_count.load(std::memory_order_relaxed);
+                while (count < i + 1 && !_worker_count.compare_exchange_weak(count, i + 1, std::memory_order_release)) {}
+                _workers[i].picks = 0;
+#ifdef DISPATCHER_METRICS
+                _workers[i].last_finish = std::chrono::steady_clock::time_point{};
+#endif
+                return &_workers[i];
+            }
+        }
+        return nullptr;
+    }
+
+    // Anything left on the deque (because processing was interrupted, or stopped idling) goes back on the shared queue, so it isn't lost with the slot; unless the queue has been interrupted, in which case it's dropped with everything else
+    void task_queue::release_worker(worker* w)
+    {
+        if (!w) { return; }
+        {
+            std::unique_lock<std::mutex> guard{ w->mutex };
+            while (!w->tasks.empty())
+            {
+                _normal.push(&w->tasks.front(), 1);
+                w->tasks.pop_front();
+            }
+            w->size.store(0, std::memory_order_relaxed);
+        }
+        w->claimed.store(false, std::memory_order_release);
+        if (_state.load(std::memory_order_seq_cst) == interrupting) { drain(); }
+    }
+
+    bool task_queue::has_tasks() const
+    {
+        if (!_high.empty() || !_normal.empty() || !_low.empty()) { return true; }
+        auto count = _worker_count.load(std::memory_order_acquire);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (_workers[i].size.load(std::memory_order_seq_cst) != 0) { return true; }
+        }
+        return false;
+    }
+
+    // A worker announces that it's about to sleep before it checks for work one last time, and a producer checks for sleepers after it has published its task; with both in sequentially consistent order, at least one of them sees the other, so a wakeup can't be lost. Returns false if it timed out with still nothing to do.
+    bool task_queue::park(std::chrono::steady_clock::duration timeout)
+    {
+        auto ready = [this]() { return has_tasks() || _state.load(std::memory_order_seq_cst) != running; };
+        auto woken = true;
+        auto self = _current.queue == this ? _current.self : nullptr;
+        counters_for(self).parked.add();
+#ifdef DISPATCHER_METRICS
+        if (self) { self->last_finish = std::chrono::steady_clock::time_point{}; }
+#endif
+        _sleepers.fetch_add(1, std::memory_order_seq_cst);
+        {
+            std::unique_lock<std::mutex> guard{ _mutex };
+            if (timeout == std::chrono::steady_clock::duration::max())
+            {
+                _cv.wait(guard, ready);
+            }
+            else
+            {
+                woken = _cv.wait_for(guard, timeout, ready);
+            }
+        }
+        _sleepers.fetch_sub(1, std::memory_order_relaxed);
+        return woken;
+    }
+
+    // Wake as many parked workers as there are new tasks for, all under one lock
+    void task_queue::wake(std::size_t count)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto sleepers = static_cast<std::size_t>(_sleepers.load(std::memory_order_seq_cst));
+        if (sleepers == 0) { return; }
         std::unique_lock<std::mutex> guard{ _mutex };
-        _tasks.push(std::move(t));
-        _cv.notify_one();
+        if (count >= sleepers)
+        {
+            _cv.notify_all();
+            return;
+        }
+        for (std::size_t i = 0; i < count; ++i) { _cv.notify_one(); }
+    }
+
+    void task_queue::add_enque_hook(void const* owner, std::function<void()> hook)
+    {
+        std::unique_lock<std::mutex> guard{ _enque_hooks_mutex };
+        _enque_hooks.emplace_back(owner, std::move(hook));
+    }
+
+    void task_queue::remove_enque_hook(void const* owner)
+    {
+        std::unique_lock<std::mutex> guard{ _enque_hooks_mutex };
+        _enque_hooks.erase(std::remove_if(_enque_hooks.begin(), _enque_hooks.end(), [owner](auto const& hook) { return hook.first == owner; }), _enque_hooks.end());
+    }
+
+    // The caller checks for work after this, and the fence pairs with the one in wake(), so an enqueue can't slip between the check and the arming unseen
+    void task_queue::arm_enque_hooks()
+    {
+        _enque_hooks_armed.store(true, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
     }
 }
@@ -0,0 +1,137 @@
+
+#include "dispatcher/metrics.hpp"
+
+#include <algorithm>
+#include <ostream>
+
+namespace dispatcher
+{
+    constexpr std::size_t histogram::bucket_count;
+
+    std::uint64_t histogram::count() const
+    {
+        std::uint64_t count = 0;
+        for (auto b : buckets) { count += b; }
+        return count;
+    }
+
+    std::chrono::nanoseconds histogram::percentile(double p) const
+    {
+        auto total = count();
+        if (total == 0) { return std::chrono::nanoseconds{ 0 }; }
+        auto rank = static_cast<std::uint64_t>(p / 100.0 * static_cast<double>(total));
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < bucket_count; ++i)
+        {
+            seen += buckets[i];
+            if (seen > rank || seen == total) { return std::chrono::nanoseconds{ i == 0 ? 0 : std::int64_t{ 1 } << i }; }
+        }
+        return std::chrono::nanoseconds{ std::int64_t{ 1 } << (bucket_count - 1) };
+    }
+
+    histogram& histogram::operator+=(histogram const& other)
+    {
+        for (std::size_t i = 0; i < bucket_count; ++i) { buckets[i] += other.buckets[i]; }
+        return *this;
+    }
+
+    worker_metrics& worker_metrics::operator+=(worker_metrics const& other)
+    {
+        enqueued += other.enqueued;
+        executed += other.executed;
+        stolen += other.stolen;
+        parked += other.parked;
+        contended += other.contended;
+        wait_time += other.wait_time;
+        run_time += other.run_time;
+        return *this;
+    }
+
+    worker_metrics metrics_snapshot::total() const
+    {
+        auto total = external;
+        for (auto const& w : workers) { total += w; }
+        return total;
+    }
+
+    namespace
+    {
+        void write_histogram(std::ostream& out, histogram const& h)
+        {
+            // Trailing empty buckets are left off
+            auto last = h.bucket_count;
+            while (last > 0 && h.buckets[last - 1] == 0) { --last; }
+            out << "{\"count\":" << h.count() << ",\"p50_ns\":" << h.percentile(50).count() << ",\"p99_ns\":" << h.percentile(99).count() << ",\"buckets\":[";
+            for (std::size_t i = 0; i < last; ++i) { out << (i ? "," : "") << h.buckets[i]; }
+            out << "]}";
+        }
+
+        void write_worker(std::ostream& out, worker_metrics const& w)
+        {
+            out << "{\"enqueued\":" << w.enqueued << ",\"executed\":" << w.executed << ",\"stolen\":" << w.stolen << ",\"parked\":" << w.parked << ",\"contended\":" << w.contended;
+            out << ",\"wait_time\":";
+            write_histogram(out, w.wait_time);
+            out << ",\"run_time\":";
+            write_histogram(out, w.run_time);
+            out << "}";
+        }
+    }
+
+    void write_json(std::ostream& out, metrics_snapshot const& snapshot)
+    {
+        out << "{\"enabled\":" << (snapshot.enabled ? "true" : "false");
+        out << ",\"depth\":{\"high\":" << snapshot.high_depth << ",\"normal\":" << snapshot.normal_depth << ",\"low\":" << snapshot.low_depth << ",\"local\":" << snapshot.local_depth << "}";
+        out << ",\"overflow_contended\":" << snapshot.overflow_contended;
+        out << ",\"total\":";
+        write_worker(out, snapshot.total());
+        out << ",\"external\":";
+        write_worker(out, snapshot.external);
+        out << ",\"workers\":[";
+        for (std::size_t i = 0; i < snapshot.workers.size(); ++i)
+        {
+            if (i) { out << ","; }
+            write_worker(out, snapshot.workers[i]);
+        }
+        out << "]}";
+    }
+
+    // Complete ("X") events, with times in microseconds from the first event
+    void write_chrome_trace(std::ostream& out, std::vector<trace_event> const& events)
+    {
+        auto origin = events.empty() ? std::chrono::steady_clock::time_point{} : std::min_element(events.begin(), events.end(), [](trace_event const& a, trace_event const& b) { return a.start < b.start; })->start;
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        for (std::size_t i = 0; i < events.size(); ++i)
+        {
+            auto const& e = events[i];
+            auto start = std::chrono::duration<double, std::micro>(e.start - origin).count();
+            auto duration = std::chrono::duration<double, std::micro>(e.duration).count();
+            out << (i ? ",\n" : "\n") << "{\"name\":\"task\",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.worker << ",\"ts\":" << start << ",\"dur\":" << duration << "}";
+        }
+        out << "\n]}\n";
+    }
+
+    namespace detail
+    {
+#ifdef DISPATCHER_METRICS
+        histogram histogram_counter::load() const
+        {
+            histogram h;
+            for (std::size_t i = 0; i < histogram::bucket_count; ++i) { h.buckets[i] = _buckets[i].load(); }
+            return h;
+        }
+#endif
+
+        worker_metrics worker_counters::load() const
+        {
+            worker_metrics w;
+            w.enqueued = enqueued.load();
+            w.executed = executed.load();
+            w.stolen = stolen.load();
+            w.parked = parked.load();
+            w.contended = contended.load();
+            w.wait_time = wait_time.load();
+            w.run_time = run_time.load();
+            return w;
+        }
+    }
+}
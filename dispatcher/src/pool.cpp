@@ -0,0 +1,178 @@
+
+#include "dispatcher/pool.hpp"
+
+#include <cstdint>
+#include <mutex>
+
+namespace dispatcher
+{
+    namespace detail
+    {
+        namespace
+        {
+            // Size classes of 16, 32, 64, 128 and 256 bytes
+            constexpr std::size_t min_block_shift = 4;
+            constexpr std::size_t size_class_count = 5;
+
+            // A thread keeps up to this many free blocks of each size; past that, it passes half of them on to the shared list
+            constexpr std::size_t max_cached = 1024;
+            constexpr std::size_t batch_size = max_cached / 2;
+
+            std::size_t size_class(std::size_t size)
+            {
+                std::size_t c = 0;
+                while ((std::size_t{ 1 } << (c + min_block_shift)) < size) { ++c; }
+                return c;
+            }
+
+            // Free blocks are linked through their own first bytes
+            struct free_block
+            {
+                free_block* next;
+            };
+
+            // A chain of batch_size blocks, as passed between threads
+            struct batch
+            {
+                free_block* first;
+                batch* next;
+            };
+
+            struct shared_lists
+            {
+                std::mutex mutex;
+                batch* batches[size_class_count] = {};
+
+                void give(std::size_t c, free_block* first)
+                {
+                    auto b = new batch{ first, nullptr };
+                    std::unique_lock<std::mutex> guard{ mutex };
+                    b->next = batches[c];
+                    batches[c] = b;
+                }
+
+                free_block* take(std::size_t c)
+                {
+                    batch* b;
+                    {
+                        std::unique_lock<std::mutex> guard{ mutex };
+                        b = batches[c];
+                        if (!b) { return nullptr; }
+                        batches[c] = b->next;
+                    }
+                    auto first = b->first;
+                    delete b;
+                    return first;
+                }
+            };
+
+            // Never destroyed, since threads may still be freeing blocks during static destruction
+            shared_lists& shared()
+            {
+                static auto lists = new shared_lists;
+                return *lists;
+            }
+
+            // Set once this thread's cache has been destroyed, after which anything it still frees (from other thread-local destructors, say) bypasses it
+            thread_local bool cache_destroyed = false;
+
+            class thread_cache
+            {
+            public:
+                ~thread_cache()
+                {
+                    cache_destroyed = true;
+                    for (std::size_t c = 0; c < size_class_count; ++c)
+                    {
+                        while (_lists[c].size >= batch_size) { give_batch(c); }
+                        while (auto b = _lists[c].first)
+                        {
+                            _lists[c].first = b->next;
+                            ::operator delete(b);
+                        }
+                    }
+                }
+
+                void* allocate(std::size_t c)
+                {
+                    auto& list = _lists[c];
+                    if (!list.first)
+                    {
+                        list.first = shared().take(c);
+                        list.size = list.first ? batch_size : 0;
+                        if (!list.first) { return ::operator new(std::size_t{ 1 } << (c + min_block_shift)); }
+                    }
+                    auto b = list.first;
+                    list.first = b->next;
+                    --list.size;
+                    return b;
+                }
+
+                void deallocate(void* p, std::size_t c)
+                {
+                    auto& list = _lists[c];
+                    list.first = new (p) free_block{ list.first };
+                    if (++list.size > max_cached) { give_batch(c); }
+                }
+
+            private:
+                struct list
+                {
+                    free_block* first = nullptr;
+                    std::size_t size = 0;
+                };
+                list _lists[size_class_count];
+
+                void give_batch(std::size_t c)
+                {
+                    auto& list = _lists[c];
+                    auto first = list.first;
+                    auto last = first;
+                    for (std::size_t i = 1; i < batch_size; ++i) { last = last->next; }
+                    list.first = last->next;
+                    list.size -= batch_size;
+                    last->next = nullptr;
+                    shared().give(c, first);
+                }
+            };
+
+            thread_local thread_cache cache;
+
+            // Over-allocate, and keep the pointer to the whole block just before the aligned part (there's always room, since operator new aligns to at least max_pooled_alignment, and the alignment here is a larger power of two)
+            void* allocate_aligned(std::size_t size, std::size_t alignment)
+            {
+                auto raw = ::operator new(size + alignment);
+                auto aligned = reinterpret_cast<void**>((reinterpret_cast<std::uintptr_t>(raw) + alignment) & ~(alignment - 1));
+                aligned[-1] = raw;
+                return aligned;
+            }
+
+            void deallocate_aligned(void* p) noexcept { ::operator delete(static_cast<void**>(p)[-1]); }
+        }
+
+        void* allocate_block(std::size_t size, std::size_t alignment)
+        {
+            if (alignment > max_pooled_alignment) { return allocate_aligned(size, alignment); }
+            if (size > max_pooled_size) { return ::operator new(size); }
+            auto c = size_class(size);
+            // Always the whole size class, since the block may yet be freed into another thread's cache
+            if (cache_destroyed) { return ::operator new(std::size_t{ 1 } << (c + min_block_shift)); }
+            return cache.allocate(c);
+        }
+
+        void deallocate_block(void* p, std::size_t size, std::size_t alignment) noexcept
+        {
+            if (alignment > max_pooled_alignment)
+            {
+                deallocate_aligned(p);
+                return;
+            }
+            if (size > max_pooled_size || cache_destroyed)
+            {
+                ::operator delete(p);
+                return;
+            }
+            cache.deallocate(p, size_class(size));
+        }
+    }
+}
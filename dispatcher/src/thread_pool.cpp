@@ -0,0 +1,222 @@
+
+#include "dispatcher/thread_pool.hpp"
+
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace dispatcher
+{
+    namespace
+    {
+        // The CPUs of a NUMA node, from the kernel's list for it (ranges and single CPUs, separated by commas, e.g. "0-3,8-11")
+        std::vector<int> numa_node_cpus(int node)
+        {
+            std::vector<int> cpus;
+            std::ifstream file{ "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist" };
+            std::string range;
+            while (std::getline(file, range, ','))
+            {
+                std::istringstream parts{ range };
+                int first = 0;
+                int last = 0;
+                char dash = 0;
+                if (!(parts >> first)) { continue; }
+                last = (parts >> dash >> last) ? last : first;
+                for (auto cpu = first; cpu <= last; ++cpu) { cpus.push_back(cpu); }
+            }
+            return cpus;
+        }
+
+        // Throws if any of the CPUs is out of range, or isn't one this process is allowed to run on (so pinning to it would fail, or pin to nothing)
+        void check_cpus(std::vector<int> const& cpus)
+        {
+#ifdef __linux__
+            if (cpus.empty()) { return; }
+            cpu_set_t allowed;
+            CPU_ZERO(&allowed);
+            if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) { throw std::system_error{ errno, std::system_category(), "sched_getaffinity" }; }
+            for (auto cpu : cpus)
+            {
+                if (cpu < 0 || cpu >= CPU_SETSIZE) { throw std::invalid_argument{ "CPU " + std::to_string(cpu) + " is out of range" }; }
+                if (!CPU_ISSET(cpu, &allowed)) { throw std::invalid_argument{ "CPU " + std::to_string(cpu) + " isn't one this process may run on" }; }
+            }
+#else
+            (void)cpus;
+#endif
+        }
+
+        // The CPUs of a NUMA node this process is allowed to run on (throwing if there aren't any)
+        std::vector<int> allowed_node_cpus(int node)
+        {
+            auto cpus = numa_node_cpus(node);
+#ifdef __linux__
+            cpu_set_t allowed;
+            CPU_ZERO(&allowed);
+            if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) { throw std::system_error{ errno, std::system_category(), "sched_getaffinity" }; }
+            cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [&](int cpu) { return cpu < 0 || cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed); }), cpus.end());
+            if (cpus.empty()) { throw std::invalid_argument{ "NUMA node " + std::to_string(node) + " has no CPUs this process may run on" }; }
+#endif
+            return cpus;
+        }
+
+        // False if the thread couldn't be pinned (the CPUs were checked when the pool was made, but the process's own affinity can change since)
+        bool pin_this_thread(std::vector<int> const& cpus)
+        {
+#ifdef __linux__
+            if (cpus.empty()) { return true; }
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (auto cpu : cpus) { CPU_SET(cpu, &set); }
+            return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+            (void)cpus;
+            return true;
+#endif
+        }
+    }
+
+    thread_pool::thread_pool(std::shared_ptr<task_queue> queue, pool_options options) : _queue{ std::move(queue) }, _options{ std::move(options) }
+    {
+        if (_options.max_threads == 0) { throw std::invalid_argument{ "a pool needs room for at least one thread" }; }
+        if (_options.min_threads > _options.max_threads) { throw std::invalid_argument{ "a pool's minimum threads can't be more than its maximum" }; }
+        check_cpus(_options.cpus);
+        if (_options.cpus.empty() && _options.numa_node >= 0) { _node_cpus = allowed_node_cpus(_options.numa_node); }
+        _queue->add_enque_hook(this, [this]()
+        {
+            std::unique_lock<std::mutex> guard{ _mutex };
+            _cv.notify_all();
+        });
+        // If a thread can't be started, the ones already running have to be stopped and joined before the exception leaves (a joinable std::thread destroyed unjoined is the end of the program)
+        try
+        {
+            {
+                std::unique_lock<std::mutex> guard{ _mutex };
+                while (_running < _options.min_threads) { start_thread(); }
+            }
+            _monitor = std::thread{ [this]() { monitor(); } };
+        }
+        catch (...)
+        {
+            join();
+            throw;
+        }
+    }
+
+    thread_pool::~thread_pool()
+    {
+        join();
+    }
+
+    std::size_t thread_pool::size() const
+    {
+        std::unique_lock<std::mutex> guard{ _mutex };
+        return _running;
+    }
+
+    std::size_t thread_pool::pin_failures() const
+    {
+        std::unique_lock<std::mutex> guard{ _mutex };
+        return _pin_failures;
+    }
+
+    task_queue::process_result thread_pool::join()
+    {
+        _queue->finish();
+        {
+            std::unique_lock<std::mutex> guard{ _mutex };
+            _stopping = true;
+            _cv.notify_all();
+        }
+        if (_monitor.joinable()) { _monitor.join(); }
+        _queue->remove_enque_hook(this);
+        // Nothing can start a thread now, so the list can be joined outside the lock (threads leaving still take the lock to say so)
+        std::vector<std::thread> threads;
+        {
+            std::unique_lock<std::mutex> guard{ _mutex };
+            threads.swap(_threads);
+        }
+        for (auto& thread : threads) { thread.join(); }
+        std::unique_lock<std::mutex> guard{ _mutex };
+        _exited.clear();
+        return _interrupted ? task_queue::process_result::interrupted : task_queue::process_result::finished;
+    }
+
+    // Called with the lock held
+    void thread_pool::start_thread()
+    {
+        auto cpus = _node_cpus;
+        if (!_options.cpus.empty()) { cpus = { _options.cpus[_started % _options.cpus.size()] }; }
+        // Counted only once it has started (it can't get as far as leaving, and uncounting itself, until the lock is released)
+        _threads.emplace_back([this, cpus]() { run(cpus); });
+        ++_started;
+        ++_running;
+    }
+
+    void thread_pool::run(std::vector<int> cpus)
+    {
+        if (!pin_this_thread(cpus))
+        {
+            std::unique_lock<std::mutex> guard{ _mutex };
+            ++_pin_failures;
+        }
+        while (true)
+        {
+            auto result = _queue->process(_options.idle_timeout);
+            std::unique_lock<std::mutex> guard{ _mutex };
+            // An idle thread stays if the pool is at its minimum (or work has turned up since it gave up), and goes round again
+            if (result == task_queue::process_result::idle && (_running <= _options.min_threads || _queue->size() > 0)) { continue; }
+            // Otherwise the queue has been finished or interrupted (and any more threads would stop straight away too), or there are more threads than needed
+            if (result == task_queue::process_result::interrupted) { _interrupted = true; }
+            if (result != task_queue::process_result::idle) { _stopping = true; }
+            --_running;
+            _exited.push_back(std::this_thread::get_id());
+            _cv.notify_all();
+            return;
+        }
+    }
+
+    void thread_pool::monitor()
+    {
+        std::unique_lock<std::mutex> guard{ _mutex };
+        while (!_stopping)
+        {
+            // Only look at the queue every so often while there's work waiting and room to grow; otherwise sleep until a thread leaves (which also wakes this, to join it), or the next enqueue, so an idle pool has no timer running
+            if (_running >= _options.max_threads)
+            {
+                _cv.wait(guard);
+            }
+            else
+            {
+                _queue->arm_enque_hooks();
+                if (_queue->has_tasks()) { _cv.wait_for(guard, _options.monitor_interval); }
+                else { _cv.wait(guard); }
+            }
+            if (_stopping) { break; }
+            reap();
+            // One thread per look at most, so that a burst of work that's soon gone doesn't bring up the whole pool at once
+            if (_running < _options.max_threads && _queue->size() > _options.tasks_per_thread * _running) { start_thread(); }
+        }
+    }
+
+    // Join the threads which have left (called with the lock held; a thread which has said it's leaving has nothing left to do but return, so this doesn't wait long)
+    void thread_pool::reap()
+    {
+        for (auto id : _exited)
+        {
+            auto thread = std::find_if(_threads.begin(), _threads.end(), [id](std::thread const& t) { return t.get_id() == id; });
+            if (thread == _threads.end()) { continue; }
+            thread->join();
+            _threads.erase(thread);
+        }
+        _exited.clear();
+    }
+}
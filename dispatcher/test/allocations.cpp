@@ -0,0 +1,27 @@
+
+#include "allocations.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<long> count{ 0 };
+
+    void* allocate(std::size_t size)
+    {
+        ++count;
+        if (auto p = std::malloc(size ? size : 1)) { return p; }
+        throw std::bad_alloc{};
+    }
+}
+
+long allocation_count() { return count.load(); }
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
@@ -0,0 +1,4 @@
+#pragma once
+
+// Every allocation through the global operator new is counted, so tests can check that a stretch of code doesn't allocate. The replacement operators live in allocations.cpp, on their own, so the compiler never sees them inlined next to the calls they replace (where it would take the malloc() and free() inside them for a mismatched pairing with new and delete).
+long allocation_count();
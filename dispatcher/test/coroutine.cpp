@@ -0,0 +1,170 @@
+
+#include <gtest/gtest.h>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "dispatcher/coroutine.hpp"
+
+namespace
+{
+    dispatcher::task<int> answer(dispatcher::task_queue& queue)
+    {
+        co_await queue.schedule();
+        co_return 42;
+    }
+
+    dispatcher::task<std::thread::id> where(dispatcher::task_queue& queue)
+    {
+        co_await queue.schedule();
+        co_return std::this_thread::get_id();
+    }
+
+    dispatcher::task<int> fail(dispatcher::task_queue& queue)
+    {
+        co_await queue.schedule();
+        throw std::runtime_error{ "oops" };
+    }
+
+    // Start a task running, without waiting for it: it runs on this thread up to its first suspension, and the future gets its result, wherever it finishes
+    template<typename T>
+    std::future<T> start(dispatcher::task<T> t)
+    {
+        std::promise<T> promise;
+        auto future = promise.get_future();
+        [](dispatcher::task<T> t, std::promise<T> promise) -> dispatcher::detail::detached
+        {
+            try
+            {
+                promise.set_value(co_await std::move(t));
+            }
+            catch (...)
+            {
+                promise.set_exception(std::current_exception());
+            }
+        }(std::move(t), std::move(promise));
+        return future;
+    }
+}
+
+TEST(Coroutine, Schedule)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    auto worker = queue->process_on_new_thread();
+    ASSERT_NE(dispatcher::sync_wait(where(*queue)), std::this_thread::get_id());
+    queue->finish();
+    ASSERT_EQ(worker.get(), dispatcher::task_queue::process_result::finished);
+}
+
+TEST(Coroutine, AwaitTask)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    auto worker = queue->process_on_new_thread();
+    auto sum = [](dispatcher::task_queue& queue) -> dispatcher::task<int>
+    {
+        auto a = co_await answer(queue);
+        auto b = co_await answer(queue);
+        co_return a + b;
+    };
+    ASSERT_EQ(dispatcher::sync_wait(sum(*queue)), 84);
+    ASSERT_THROW(dispatcher::sync_wait(fail(*queue)), std::runtime_error);
+    queue->finish();
+    ASSERT_EQ(worker.get(), dispatcher::task_queue::process_result::finished);
+}
+
+TEST(Coroutine, AwaitFuture)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    auto worker = queue->process_on_new_thread();
+    auto twice = [](std::shared_ptr<dispatcher::task_queue> queue) -> dispatcher::task<int>
+    {
+        auto value = co_await queue->submit([]() { return 21; });
+        co_return value * 2;
+    };
+    ASSERT_EQ(dispatcher::sync_wait(twice(queue)), 42);
+    queue->finish();
+    ASSERT_EQ(worker.get(), dispatcher::task_queue::process_result::finished);
+}
+
+// A thousand coroutines all waiting at once on one worker: suspended, they're just tasks in the queue, so they don't need a thread each
+TEST(Coroutine, ManySuspended)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    auto child = [](dispatcher::task_queue& queue, int i) -> dispatcher::task<int>
+    {
+        co_await queue.schedule();
+        co_return i;
+    };
+
+    // Each one runs up to its co_await before the worker starts, so all thousand are suspended together
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 1000; ++i) { results.push_back(start(child(*queue, i))); }
+    ASSERT_EQ(queue->size(), 1000u);
+
+    auto worker = queue->process_on_new_thread();
+    int sum = 0;
+    for (auto& result : results) { sum += result.get(); }
+    ASSERT_EQ(sum, 499500);
+    queue->finish();
+    ASSERT_EQ(worker.get(), dispatcher::task_queue::process_result::finished);
+}
+
+// A coroutine waiting on a queue which is interrupted (or destroyed) before it gets to it is resumed with task_cancelled, rather than left suspended for ever
+TEST(Coroutine, InterruptWhileSuspended)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    auto scheduled = start(answer(*queue));
+    auto awaited = start([](std::shared_ptr<dispatcher::task_queue> queue) -> dispatcher::task<int>
+    {
+        co_return co_await queue->submit([]() { return 42; });
+    }(queue));
+    ASSERT_EQ(queue->size(), 2u);
+    queue->interrupt();
+    ASSERT_THROW(scheduled.get(), dispatcher::task_cancelled);
+    ASSERT_THROW(awaited.get(), dispatcher::task_cancelled);
+
+    auto destroyed = std::make_shared<dispatcher::task_queue>();
+    auto orphaned = start(answer(*destroyed));
+    destroyed.reset();
+    ASSERT_THROW(orphaned.get(), dispatcher::task_cancelled);
+
+    // sync_wait doesn't hang, either
+    auto interrupted = std::make_shared<dispatcher::task_queue>();
+    auto waiter = std::async(std::launch::async, [&interrupted]() { return dispatcher::sync_wait(answer(*interrupted)); });
+    while (interrupted->size() == 0) { std::this_thread::yield(); }
+    interrupted->interrupt();
+    ASSERT_THROW(waiter.get(), dispatcher::task_cancelled);
+}
+
+// Destroying a queue resumes the coroutines suspended on it before any of the queue is torn down, so they can still use it on their way out (and find it interrupted); and one that goes to suspend on an interrupted queue doesn't suspend at all
+TEST(Coroutine, DestroyWhileSuspended)
+{
+    auto queue = std::make_unique<dispatcher::task_queue>();
+    auto retry = [](dispatcher::task_queue& queue) -> dispatcher::task<int>
+    {
+        try
+        {
+            co_await queue.schedule();
+        }
+        catch (dispatcher::task_cancelled const&)
+        {
+        }
+        queue.post([]() {});
+        co_await queue.schedule();
+        co_return 42;
+    };
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 10; ++i) { results.push_back(start(retry(*queue))); }
+    ASSERT_EQ(queue->size(), 10u);
+    queue.reset();
+    for (auto& result : results) { ASSERT_THROW(result.get(), dispatcher::task_cancelled); }
+
+    auto interrupted = std::make_shared<dispatcher::task_queue>();
+    interrupted->interrupt();
+    auto late = start(answer(*interrupted));
+    ASSERT_EQ(late.wait_for(std::chrono::seconds{ 0 }), std::future_status::ready);
+    ASSERT_THROW(late.get(), dispatcher::task_cancelled);
+    ASSERT_EQ(interrupted->size(), 0u);
+}
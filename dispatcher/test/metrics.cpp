@@ -0,0 +1,118 @@
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "dispatcher/dispatcher.hpp"
+#include "dispatcher/metrics.hpp"
+
+using namespace std::chrono_literals;
+
+TEST(Metrics, Histogram)
+{
+    dispatcher::histogram h;
+    h.buckets[0] = 1;
+    h.buckets[10] = 98;
+    h.buckets[20] = 1;
+    ASSERT_EQ(h.count(), 100u);
+    ASSERT_EQ(h.percentile(0), 0ns);
+    ASSERT_EQ(h.percentile(50), 1024ns);
+    ASSERT_EQ(h.percentile(99), 1048576ns);
+}
+
+TEST(Metrics, CountsTasks)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    for (int i = 0; i < 10; ++i)
+    {
+        queue->post([](){ std::this_thread::sleep_for(1ms); });
+    }
+    auto before = queue->metrics();
+    ASSERT_TRUE(before.enabled);
+    ASSERT_EQ(before.depth(), 10u);
+    ASSERT_EQ(before.normal_depth, 10u);
+    ASSERT_EQ(before.external.enqueued, 10u);
+
+    queue->finish();
+    queue->process();
+    auto after = queue->metrics();
+    ASSERT_EQ(after.depth(), 0u);
+    ASSERT_EQ(after.workers.size(), 1u);
+    auto total = after.total();
+    ASSERT_EQ(total.enqueued, 10u);
+    ASSERT_EQ(total.executed, 10u);
+    ASSERT_EQ(total.run_time.count(), 10u);
+    ASSERT_EQ(total.wait_time.count(), 10u);
+    ASSERT_GE(total.run_time.percentile(50), 1ms);
+}
+
+TEST(Metrics, CountsStealsAndParks)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    auto worker1 = queue->process_on_new_thread();
+    auto worker2 = queue->process_on_new_thread();
+    // One task spawns more onto its own deque and then stays busy, so the other worker has to steal them
+    queue->enque([&queue]()
+    {
+        for (int i = 0; i < 8; ++i) { queue->post([](){}); }
+        std::this_thread::sleep_for(50ms);
+    }).get();
+    queue->finish();
+    worker1.get();
+    worker2.get();
+    auto total = queue->metrics().total();
+    ASSERT_EQ(total.enqueued, 9u);
+    ASSERT_EQ(total.executed, 9u);
+    ASSERT_GE(total.stolen, 1u);
+    ASSERT_GE(total.parked, 1u);
+}
+
+TEST(Metrics, ExternalProducers)
+{
+    // Threads without a worker slot count in separate sets of counters, but the snapshot adds them all up
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    std::vector<std::thread> producers;
+    for (int i = 0; i < 20; ++i)
+    {
+        producers.emplace_back([&queue]()
+        {
+            for (int j = 0; j < 100; ++j) { queue->post([](){}); }
+        });
+    }
+    for (auto& producer : producers) { producer.join(); }
+    ASSERT_EQ(queue->metrics().external.enqueued, 2000u);
+    queue->finish();
+    queue->process();
+    ASSERT_EQ(queue->metrics().total().executed, 2000u);
+}
+
+TEST(Metrics, Json)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    queue->post([](){});
+    std::ostringstream out;
+    dispatcher::write_json(out, queue->metrics());
+    auto json = out.str();
+    ASSERT_EQ(json.front(), '{');
+    ASSERT_EQ(json.back(), '}');
+    ASSERT_NE(json.find("\"enabled\":true"), std::string::npos);
+    ASSERT_NE(json.find("\"normal\":1"), std::string::npos);
+}
+
+TEST(Metrics, Trace)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    queue->post([](){});
+    queue->start_trace();
+    queue->post([](){});
+    queue->post([](){});
+    queue->finish();
+    queue->process();
+    auto events = queue->stop_trace();
+    ASSERT_EQ(events.size(), 3u);
+    std::ostringstream out;
+    dispatcher::write_chrome_trace(out, events);
+    ASSERT_NE(out.str().find("\"ph\":\"X\""), std::string::npos);
+}
@@ -1,7 +1,24 @@
 
 #include <gtest/gtest.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <numeric>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "dispatcher/dispatcher.hpp"
+#include "dispatcher/future.hpp"
+#include "dispatcher/thread_pool.hpp"
+
+#include "allocations.hpp"
 
 using namespace std::chrono_literals;
 
@@ -33,7 +50,8 @@ TEST(Dispatcher, InterruptSync)
     auto result = queue->enque([](){ return 42; });
     queue->interrupt();
     ASSERT_EQ(queue->process(), dispatcher::task_queue::process_result::interrupted);
-    ASSERT_EQ(result.wait_for(std::chrono::seconds::zero()), std::future_status::timeout);
+    ASSERT_EQ(result.wait_for(std::chrono::seconds::zero()), std::future_status::ready);
+    ASSERT_THROW(result.get(), dispatcher::task_cancelled);
 }
 
 TEST(Dispatcher, SingleAsync)
@@ -101,19 +119,594 @@ TEST(Dispatcher, InterruptPool)
         ASSERT_EQ(process_result.get(), dispatcher::task_queue::process_result::interrupted);
     }
 
-    int ready_count = 0;
-    int waiting_count = 0;
+    int ran_count = 0;
+    int cancelled_count = 0;
     for (auto& result : results)
     {
-        if (result.wait_for(0s) == std::future_status::ready)
+        ASSERT_EQ(result.wait_for(0s), std::future_status::ready);
+        try
+        {
+            result.get();
+            ++ran_count;
+        }
+        catch (dispatcher::task_cancelled const&)
+        {
+            ++cancelled_count;
+        }
+    }
+    ASSERT_GE(ran_count, 4);
+    ASSERT_GE(cancelled_count, 4);
+}
+
+TEST(Dispatcher, Overflow)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>(4);
+    std::vector<int> order;
+    std::vector<std::future<void>> results;
+    for (int i = 0; i < 100; ++i)
+    {
+        results.push_back(queue->enque([&order, i](){ order.push_back(i); }));
+    }
+    queue->finish();
+    ASSERT_EQ(queue->process(), dispatcher::task_queue::process_result::finished);
+    ASSERT_EQ(order.size(), 100u);
+    for (int i = 0; i < 100; ++i)
+    {
+        ASSERT_EQ(order[i], i);
+    }
+}
+
+TEST(Dispatcher, ManyProducersManyWorkers)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>(64);
+    std::atomic<int> sum{ 0 };
+    std::vector<std::future<dispatcher::task_queue::process_result>> process_results;
+    for (int i = 0; i < 4; ++i)
+    {
+        process_results.push_back(queue->process_on_new_thread());
+    }
+    std::vector<std::thread> producers;
+    for (int p = 0; p < 4; ++p)
+    {
+        producers.emplace_back([&queue, &sum]()
+        {
+            for (int i = 0; i < 10000; ++i)
+            {
+                queue->enque([&sum](){ ++sum; });
+            }
+        });
+    }
+    for (auto& producer : producers) { producer.join(); }
+    queue->finish();
+    for (auto& process_result : process_results)
+    {
+        ASSERT_EQ(process_result.get(), dispatcher::task_queue::process_result::finished);
+    }
+    ASSERT_EQ(sum, 40000);
+}
+
+TEST(Dispatcher, LocalTasksRunNewestFirst)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    std::vector<int> order;
+    queue->enque([&queue, &order]()
+    {
+        for (int i = 0; i < 3; ++i)
         {
-            ++ready_count;
+            queue->enque([&order, i](){ order.push_back(i); });
         }
-        else
+    });
+    queue->finish();
+    ASSERT_EQ(queue->process(), dispatcher::task_queue::process_result::finished);
+    ASSERT_EQ(order, (std::vector<int>{ 2, 1, 0 }));
+}
+
+TEST(Dispatcher, IdleWorkersSteal)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    std::vector<std::future<dispatcher::task_queue::process_result>> process_results;
+    for (int i = 0; i < 4; ++i)
+    {
+        process_results.push_back(queue->process_on_new_thread());
+    }
+    auto spawned = queue->enque([&]()
+    {
+        std::vector<std::future<void>> results;
+        for (int i = 0; i < 8; ++i)
         {
-            ++waiting_count;
+            results.push_back(queue->enque([&]()
+            {
+                std::this_thread::sleep_for(20ms);
+                std::unique_lock<std::mutex> guard{ mutex };
+                threads.insert(std::this_thread::get_id());
+            }));
         }
+        return results;
+    }).get();
+    for (auto& result : spawned) { result.get(); }
+    queue->finish();
+    for (auto& process_result : process_results)
+    {
+        ASSERT_EQ(process_result.get(), dispatcher::task_queue::process_result::finished);
+    }
+    ASSERT_GT(threads.size(), 1u);
+}
+
+TEST(Dispatcher, Post)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    int sum = 0;
+    for (int i = 0; i < 10; ++i)
+    {
+        queue->post([&sum, i](){ sum += i; });
+    }
+    queue->finish();
+    ASSERT_EQ(queue->process(), dispatcher::task_queue::process_result::finished);
+    ASSERT_EQ(sum, 45);
+}
+
+TEST(Dispatcher, LargeTask)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    std::array<int, 64> values;
+    values.fill(1);
+    auto result = queue->enque([values](){ return std::accumulate(values.begin(), values.end(), 0); });
+    queue->finish();
+    ASSERT_EQ(queue->process(), dispatcher::task_queue::process_result::finished);
+    ASSERT_EQ(result.get(), 64);
+}
+
+TEST(Dispatcher, OverAlignedTask)
+{
+    struct alignas(64) aligned_value
+    {
+        int value;
+    };
+    struct alignas(64) aligned_functor
+    {
+        int value;
+        aligned_value operator()() const
+        {
+            EXPECT_EQ(reinterpret_cast<std::uintptr_t>(this) % 64, 0u);
+            return aligned_value{ value };
+        }
+    };
+
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    std::vector<std::future<aligned_value>> results;
+    for (int i = 0; i < 100; ++i)
+    {
+        results.push_back(queue->enque(aligned_functor{ i }));
+        queue->post(aligned_functor{ i });
+    }
+    queue->finish();
+    ASSERT_EQ(queue->process(), dispatcher::task_queue::process_result::finished);
+    for (int i = 0; i < 100; ++i)
+    {
+        ASSERT_EQ(results[i].get().value, i);
+    }
+}
+
+TEST(Dispatcher, PostDoesNotAllocate)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    int sum = 0;
+    auto before = allocation_count();
+    for (int i = 0; i < 1000; ++i)
+    {
+        queue->post([&sum, i](){ sum += i; });
+    }
+    queue->finish();
+    ASSERT_EQ(queue->process(), dispatcher::task_queue::process_result::finished);
+    ASSERT_EQ(allocation_count(), before);
+    ASSERT_EQ(sum, 499500);
+}
+
+TEST(Dispatcher, EnqueDoesNotAllocateOnceWarm)
+{
+    std::vector<std::future<int>> results;
+    results.reserve(500);
+    auto run = [&results]()
+    {
+        auto queue = std::make_shared<dispatcher::task_queue>();
+        auto before = allocation_count();
+        for (int i = 0; i < 500; ++i)
+        {
+            results.push_back(queue->enque([i](){ return i; }));
+        }
+        queue->finish();
+        queue->process();
+        for (int i = 0; i < 500; ++i)
+        {
+            EXPECT_EQ(results[i].get(), i);
+        }
+        results.clear();
+        return allocation_count() - before;
+    };
+    run();
+    ASSERT_EQ(run(), 0);
+}
+
+TEST(Dispatcher, EnqueBulk)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>(16);
+    std::vector<std::function<int()>> work;
+    for (int i = 0; i < 100; ++i)
+    {
+        work.push_back([i](){ return i * i; });
+    }
+    auto results = queue->enque_bulk(work);
+    ASSERT_EQ(results.size(), 100u);
+    queue->finish();
+    ASSERT_EQ(queue->process(), dispatcher::task_queue::process_result::finished);
+    for (int i = 0; i < 100; ++i)
+    {
+        ASSERT_EQ(results[i].get(), i * i);
+    }
+}
+
+TEST(Dispatcher, EnqueBulkPool)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    std::vector<std::future<dispatcher::task_queue::process_result>> process_results;
+    for (int i = 0; i < 4; ++i)
+    {
+        process_results.push_back(queue->process_on_new_thread());
+    }
+    std::atomic<int> sum{ 0 };
+    std::vector<std::function<void()>> work(20000, [&sum](){ ++sum; });
+    auto results = queue->enque_bulk(work.begin(), work.end());
+    for (auto& result : results) { result.get(); }
+    queue->finish();
+    for (auto& process_result : process_results)
+    {
+        ASSERT_EQ(process_result.get(), dispatcher::task_queue::process_result::finished);
+    }
+    ASSERT_EQ(sum, 20000);
+}
+
+TEST(Dispatcher, Priority)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    std::string order;
+    auto record = [&order](char c){ return [&order, c](){ order.push_back(c); }; };
+    queue->enque(record('n'));
+    queue->enque(record('l'), dispatcher::task_queue::priority::low);
+    for (int i = 0; i < 5; ++i)
+    {
+        queue->enque(record('h'), dispatcher::task_queue::priority::high);
+    }
+    queue->finish();
+    ASSERT_EQ(queue->process(), dispatcher::task_queue::process_result::finished);
+    // Every fourth pick goes to normal priority work first
+    ASSERT_EQ(order, "hhhnhhl");
+}
+
+TEST(Dispatcher, LowPriorityIsNotStarved)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    std::string order;
+    queue->enque([&order](){ order.push_back('l'); }, dispatcher::task_queue::priority::low);
+    for (int i = 0; i < 40; ++i)
+    {
+        queue->enque([&order](){ order.push_back('h'); }, dispatcher::task_queue::priority::high);
+    }
+    queue->finish();
+    ASSERT_EQ(queue->process(), dispatcher::task_queue::process_result::finished);
+    ASSERT_EQ(order.find('l'), 15u);
+}
+
+TEST(Dispatcher, Deadline)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    auto expired = queue->enque([](){ return 42; }, std::chrono::steady_clock::now() - 1ms);
+    auto in_time = queue->enque([](){ return 1337; }, 1h, dispatcher::task_queue::priority::high);
+    queue->finish();
+    ASSERT_EQ(queue->process(), dispatcher::task_queue::process_result::finished);
+    ASSERT_THROW(expired.get(), dispatcher::task_timeout);
+    ASSERT_EQ(in_time.get(), 1337);
+}
+
+TEST(Dispatcher, Then)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    auto result = queue->submit([](){ return 6; })
+        .then([](dispatcher::future<int> f){ return f.get() * 7; })
+        .then([](dispatcher::future<int> f){ return std::to_string(f.get()); });
+    queue->finish();
+    ASSERT_EQ(queue->process(), dispatcher::task_queue::process_result::finished);
+    ASSERT_TRUE(result.is_ready());
+    ASSERT_EQ(result.get(), "42");
+}
+
+TEST(Dispatcher, ThenPropagatesErrors)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    auto result = queue->submit([]() -> int { throw std::runtime_error{ "oops" }; })
+        .then([](dispatcher::future<int> f){ return f.get() + 1; });
+    queue->finish();
+    ASSERT_EQ(queue->process(), dispatcher::task_queue::process_result::finished);
+    ASSERT_THROW(result.get(), std::runtime_error);
+}
+
+// A diamond: b and c both depend on a, and d on both of them. It all runs on the one thread doing the processing, so if anything blocked waiting for its inputs, this would never finish.
+TEST(Dispatcher, TaskGraph)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    auto a = queue->submit([](){ return 2; });
+    auto b = a.then([](dispatcher::future<int> f){ return f.get() + 1; });
+    auto c = a.then([](dispatcher::future<int> f){ return f.get() * 10; });
+    auto d = dispatcher::when_all(b, c).then([](auto f)
+    {
+        auto inputs = f.get();
+        return std::get<0>(inputs).get() + std::get<1>(inputs).get();
+    });
+    queue->finish();
+    ASSERT_EQ(queue->process(), dispatcher::task_queue::process_result::finished);
+    ASSERT_EQ(d.get(), 23);
+}
+
+TEST(Dispatcher, WhenAllWhenAny)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    std::promise<void> gate;
+    auto opened = gate.get_future().share();
+    std::vector<dispatcher::future<int>> inputs;
+    inputs.push_back(queue->submit([opened](){ opened.wait(); return 0; }));
+    inputs.push_back(queue->submit([](){ return 1; }));
+    auto any = dispatcher::when_any(inputs.begin(), inputs.end());
+    auto all = dispatcher::when_all(inputs.begin(), inputs.end()).then([](auto f)
+    {
+        int sum = 0;
+        for (auto const& input : f.get()) { sum += input.get(); }
+        return sum;
+    });
+    auto worker1 = queue->process_on_new_thread();
+    auto worker2 = queue->process_on_new_thread();
+    any.wait();
+    ASSERT_EQ(any.get().index, 1u);
+    ASSERT_FALSE(all.is_ready());
+    gate.set_value();
+    ASSERT_EQ(all.get(), 1);
+    queue->finish();
+    ASSERT_EQ(worker1.get(), dispatcher::task_queue::process_result::finished);
+    ASSERT_EQ(worker2.get(), dispatcher::task_queue::process_result::finished);
+}
+
+TEST(Dispatcher, WhenAllWhenAnyEmpty)
+{
+    // Nothing to wait for, and no queue: the results are ready, and continuations on them (and on those) run inline
+    std::vector<dispatcher::future<int>> inputs;
+    auto all = dispatcher::when_all(inputs.begin(), inputs.end()).then([](auto f) { return static_cast<int>(f.get().size()); }).then([](auto f) { return f.get() + 1; });
+    ASSERT_TRUE(all.is_ready());
+    ASSERT_EQ(all.get(), 1);
+    auto any = dispatcher::when_any(inputs.begin(), inputs.end()).then([](auto f) { return f.get().index; });
+    ASSERT_TRUE(any.is_ready());
+    ASSERT_EQ(any.get(), static_cast<std::size_t>(-1));
+}
+
+TEST(Dispatcher, AbandonedContinuationIsCancelled)
+{
+    dispatcher::future<int> result;
+    {
+        auto queue = std::make_shared<dispatcher::task_queue>();
+        result = queue->submit([](){ return 1; }).then([](dispatcher::future<int> f){ return f.get(); });
+    }
+    ASSERT_THROW(result.get(), dispatcher::task_cancelled);
+}
+
+TEST(Dispatcher, ThreadPoolJoin)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    dispatcher::pool_options options;
+    options.min_threads = 2;
+    options.max_threads = 2;
+    dispatcher::thread_pool pool{ queue, options };
+    ASSERT_EQ(pool.size(), 2u);
+    std::atomic<int> count{ 0 };
+    for (int i = 0; i < 1000; ++i)
+    {
+        queue->post([&count](){ ++count; });
     }
-    ASSERT_GE(ready_count, 4);
-    ASSERT_GE(waiting_count, 4);
+    ASSERT_EQ(pool.join(), dispatcher::task_queue::process_result::finished);
+    ASSERT_EQ(count, 1000);
+    ASSERT_EQ(pool.size(), 0u);
+}
+
+TEST(Dispatcher, ThreadPoolGrowsAndShrinks)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    dispatcher::pool_options options;
+    options.min_threads = 1;
+    options.max_threads = 4;
+    options.tasks_per_thread = 1;
+    options.idle_timeout = 20ms;
+    dispatcher::thread_pool pool{ queue, options };
+    std::promise<void> gate;
+    auto open = gate.get_future().share();
+    for (int i = 0; i < 8; ++i)
+    {
+        queue->post([open](){ open.wait(); });
+    }
+    auto wait_for_size = [&pool](std::size_t size)
+    {
+        for (auto until = std::chrono::steady_clock::now() + 10s; pool.size() != size && std::chrono::steady_clock::now() < until; ) { std::this_thread::sleep_for(1ms); }
+        return pool.size();
+    };
+    ASSERT_EQ(wait_for_size(4), 4u);
+    gate.set_value();
+    ASSERT_EQ(wait_for_size(1), 1u);
+    ASSERT_EQ(pool.join(), dispatcher::task_queue::process_result::finished);
+}
+
+TEST(Dispatcher, ThreadPoolInterrupt)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    dispatcher::pool_options options;
+    options.max_threads = 1;
+    dispatcher::thread_pool pool{ queue, options };
+    std::promise<void> started;
+    std::atomic<int> count{ 0 };
+    queue->post([&started](){ started.set_value(); std::this_thread::sleep_for(20ms); });
+    for (int i = 0; i < 100; ++i)
+    {
+        queue->post([&count](){ ++count; });
+    }
+    started.get_future().wait();
+    queue->interrupt();
+    ASSERT_EQ(pool.join(), dispatcher::task_queue::process_result::interrupted);
+    ASSERT_LT(count, 100);
+}
+
+TEST(Dispatcher, ThreadPoolStartsEmpty)
+{
+    // With no threads and nothing queued, the monitor sleeps until the first enqueue wakes it
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    dispatcher::pool_options options;
+    options.min_threads = 0;
+    options.max_threads = 1;
+    options.monitor_interval = 1h;
+    dispatcher::thread_pool pool{ queue, options };
+    std::this_thread::sleep_for(10ms);
+    ASSERT_EQ(pool.size(), 0u);
+    ASSERT_EQ(queue->enque([](){ return 1; }).get(), 1);
+    ASSERT_EQ(pool.join(), dispatcher::task_queue::process_result::finished);
+}
+
+TEST(Dispatcher, ThreadPoolBadOptions)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    dispatcher::pool_options options;
+    options.min_threads = 0;
+    options.max_threads = 0;
+    ASSERT_THROW((dispatcher::thread_pool{ queue, options }), std::invalid_argument);
+    options.min_threads = 3;
+    options.max_threads = 2;
+    ASSERT_THROW((dispatcher::thread_pool{ queue, options }), std::invalid_argument);
+}
+
+#ifdef __linux__
+TEST(Dispatcher, ThreadPoolAffinity)
+{
+    // Pinning to the only CPU there is proves nothing, so this needs a choice of at least two
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+    if (CPU_COUNT(&allowed) < 2) { GTEST_SKIP(); }
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed)) { ++cpu; }
+
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    dispatcher::pool_options options;
+    options.cpus = { cpu };
+    dispatcher::thread_pool pool{ queue, options };
+    ASSERT_EQ(queue->enque([](){ return sched_getcpu(); }).get(), cpu);
+    ASSERT_EQ(pool.pin_failures(), 0u);
+}
+
+TEST(Dispatcher, ThreadPoolBadAffinity)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    dispatcher::pool_options options;
+    options.cpus = { -1 };
+    ASSERT_THROW((dispatcher::thread_pool{ queue, options }), std::invalid_argument);
+    options.cpus = { CPU_SETSIZE };
+    ASSERT_THROW((dispatcher::thread_pool{ queue, options }), std::invalid_argument);
+    options.cpus = {};
+    options.numa_node = 1 << 20;
+    ASSERT_THROW((dispatcher::thread_pool{ queue, options }), std::invalid_argument);
+}
+#endif
+
+TEST(Dispatcher, MetricsDepthOnly)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    queue->post([](){});
+    queue->enque([](){}, dispatcher::task_queue::priority::high);
+    auto metrics = queue->metrics();
+#ifdef DISPATCHER_METRICS
+    ASSERT_TRUE(metrics.enabled);
+#else
+    ASSERT_FALSE(metrics.enabled);
+    ASSERT_EQ(metrics.total().enqueued, 0u);
+#endif
+    ASSERT_EQ(metrics.depth(), 2u);
+    ASSERT_EQ(metrics.high_depth, 1u);
+    ASSERT_EQ(queue->size(), 2u);
+}
+
+TEST(Dispatcher, AbandonedTaskIsCancelled)
+{
+    std::future<int> result;
+    {
+        auto queue = std::make_shared<dispatcher::task_queue>();
+        result = queue->enque([](){ return 1; });
+    }
+    ASSERT_THROW(result.get(), dispatcher::task_cancelled);
+}
+
+TEST(Dispatcher, EnqueAfterInterruptIsCancelled)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    queue->interrupt();
+    auto result = queue->enque([](){ return 1; });
+    ASSERT_EQ(result.wait_for(0s), std::future_status::ready);
+    ASSERT_THROW(result.get(), dispatcher::task_cancelled);
+}
+
+TEST(Dispatcher, Cancel)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    dispatcher::cancellation_source group;
+    dispatcher::cancellation_source other;
+    auto resource = std::make_shared<int>(42);
+    auto cancelled1 = queue->enque([resource](){ return *resource; }, group.token());
+    auto cancelled2 = queue->enque([resource](){ return *resource; }, group.token(), dispatcher::task_queue::priority::high);
+    auto kept = queue->enque([resource](){ return *resource; }, other.token());
+    ASSERT_EQ(resource.use_count(), 4);
+    group.cancel();
+    // The cancelled tasks have let go of what they held, and their futures are done, without the queue having got to them
+    ASSERT_EQ(resource.use_count(), 2);
+    ASSERT_EQ(cancelled1.wait_for(0s), std::future_status::ready);
+    ASSERT_THROW(cancelled1.get(), dispatcher::task_cancelled);
+    ASSERT_THROW(cancelled2.get(), dispatcher::task_cancelled);
+    auto late = queue->enque([](){ return 1; }, group.token());
+    ASSERT_THROW(late.get(), dispatcher::task_cancelled);
+    queue->finish();
+    ASSERT_EQ(queue->process(), dispatcher::task_queue::process_result::finished);
+    ASSERT_EQ(kept.get(), 42);
+}
+
+TEST(Dispatcher, StopRequested)
+{
+    auto queue = std::make_shared<dispatcher::task_queue>();
+    auto worker = queue->process_on_new_thread();
+    dispatcher::cancellation_source source;
+    std::promise<void> started;
+    auto result = queue->enque([&started]()
+    {
+        started.set_value();
+        int polls = 0;
+        while (!dispatcher::this_task::stop_requested()) { ++polls; std::this_thread::yield(); }
+        return polls;
+    }, source.token());
+    started.get_future().wait();
+    ASSERT_FALSE(dispatcher::this_task::stop_requested());
+    source.cancel();
+    // It had started, so it runs to the end (and sees the cancellation on the way)
+    ASSERT_GE(result.get(), 0);
+
+    std::promise<void> started_again;
+    auto interrupted = queue->enque([&started_again]()
+    {
+        started_again.set_value();
+        while (!dispatcher::this_task::stop_requested()) { std::this_thread::yield(); }
+        return dispatcher::this_task::token().stop_requested();
+    });
+    started_again.get_future().wait();
+    queue->interrupt();
+    ASSERT_FALSE(interrupted.get());
+    ASSERT_EQ(worker.get(), dispatcher::task_queue::process_result::interrupted);
 }
@@ -0,0 +1,113 @@
+
+#include <benchmark/benchmark.h>
+#include <string>
+
+#include "obfuscated/access.hpp"
+#include "obfuscated/obfuscated_string.hpp"
+
+namespace
+{
+    constexpr char text16[] = "0123456789abcdef";
+    constexpr char text64[] = "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef";
+    constexpr char text256[] =
+        "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+        "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+        "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+        "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef";
+#define OBFUSCATED_BENCH_256 \
+        "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef" \
+        "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef" \
+        "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef" \
+        "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+    constexpr char text1024[] = OBFUSCATED_BENCH_256 OBFUSCATED_BENCH_256 OBFUSCATED_BENCH_256 OBFUSCATED_BENCH_256;
+    constexpr char text4096[] =
+        OBFUSCATED_BENCH_256 OBFUSCATED_BENCH_256 OBFUSCATED_BENCH_256 OBFUSCATED_BENCH_256
+        OBFUSCATED_BENCH_256 OBFUSCATED_BENCH_256 OBFUSCATED_BENCH_256 OBFUSCATED_BENCH_256
+        OBFUSCATED_BENCH_256 OBFUSCATED_BENCH_256 OBFUSCATED_BENCH_256 OBFUSCATED_BENCH_256
+        OBFUSCATED_BENCH_256 OBFUSCATED_BENCH_256 OBFUSCATED_BENCH_256 OBFUSCATED_BENCH_256;
+#undef OBFUSCATED_BENCH_256
+
+    // The cost of decoding a secret into a string, against simply copying the plain text into one
+    template<std::size_t N>
+    void BM_Decode(benchmark::State& state, char const (&text)[N])
+    {
+        auto s = obfuscated::obfuscate(text);
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(std::string{ s });
+        }
+        state.SetBytesProcessed(state.iterations() * (N - 1));
+    }
+    BENCHMARK_CAPTURE(BM_Decode, 16, text16);
+    BENCHMARK_CAPTURE(BM_Decode, 64, text64);
+    BENCHMARK_CAPTURE(BM_Decode, 256, text256);
+    BENCHMARK_CAPTURE(BM_Decode, 1024, text1024);
+    BENCHMARK_CAPTURE(BM_Decode, 4096, text4096);
+
+    // Decoding into a buffer the caller already has, with no allocation
+    template<std::size_t N>
+    void BM_DecodeInto(benchmark::State& state, char const (&text)[N])
+    {
+        auto s = obfuscated::obfuscate(text);
+        char buffer[N];
+        for (auto _ : state)
+        {
+            // (So the compiler can't decode it once, at compile time, and skip the loop)
+            benchmark::DoNotOptimize(s);
+            benchmark::DoNotOptimize(s.decode_into(buffer));
+            benchmark::DoNotOptimize(buffer);
+        }
+        state.SetBytesProcessed(state.iterations() * (N - 1));
+    }
+    BENCHMARK_CAPTURE(BM_DecodeInto, 16, text16);
+    BENCHMARK_CAPTURE(BM_DecodeInto, 256, text256);
+    BENCHMARK_CAPTURE(BM_DecodeInto, 4096, text4096);
+
+    // Reading a cached secret, after the first read has decoded it: per access, against BM_Decode's conversion to a new string each time
+    template<std::size_t N>
+    void BM_Cached(benchmark::State& state, char const (&text)[N])
+    {
+        obfuscated::cached_string<char> const s{ obfuscated::obfuscate(text) };
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(s.get().data());
+        }
+    }
+    BENCHMARK_CAPTURE(BM_Cached, 16, text16);
+    BENCHMARK_CAPTURE(BM_Cached, 256, text256);
+    BENCHMARK_CAPTURE(BM_Cached, 4096, text4096);
+
+    // A scoped view per access: decoded onto the stack, and wiped afterwards
+    template<std::size_t N>
+    void BM_Scoped(benchmark::State& state, char const (&text)[N])
+    {
+        auto s = obfuscated::obfuscate(text);
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(s);
+            auto v = obfuscated::view(s);
+            benchmark::DoNotOptimize(v.data());
+            benchmark::ClobberMemory();
+        }
+        state.SetBytesProcessed(state.iterations() * (N - 1));
+    }
+    BENCHMARK_CAPTURE(BM_Scoped, 16, text16);
+    BENCHMARK_CAPTURE(BM_Scoped, 256, text256);
+    BENCHMARK_CAPTURE(BM_Scoped, 4096, text4096);
+
+    template<std::size_t N>
+    void BM_Plain(benchmark::State& state, char const (&text)[N])
+    {
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(std::string{ text, N - 1 });
+        }
+        state.SetBytesProcessed(state.iterations() * (N - 1));
+    }
+    BENCHMARK_CAPTURE(BM_Plain, 16, text16);
+    BENCHMARK_CAPTURE(BM_Plain, 64, text64);
+    BENCHMARK_CAPTURE(BM_Plain, 256, text256);
+    BENCHMARK_CAPTURE(BM_Plain, 4096, text4096);
+}
+
+BENCHMARK_MAIN();
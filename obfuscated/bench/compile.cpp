@@ -0,0 +1,40 @@
+
+// Not run: compiling this is the benchmark. It obfuscates 16 literals of 4 KB each (64 KB in all), at compile time; time the build of the obfuscated-compile-bench target to see what long secrets cost the compiler.
+
+#include <cstddef>
+
+#include "obfuscated/obfuscated_string.hpp"
+
+#define OBFUSCATED_BENCH_64 "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+#define OBFUSCATED_BENCH_1K \
+    OBFUSCATED_BENCH_64 OBFUSCATED_BENCH_64 OBFUSCATED_BENCH_64 OBFUSCATED_BENCH_64 \
+    OBFUSCATED_BENCH_64 OBFUSCATED_BENCH_64 OBFUSCATED_BENCH_64 OBFUSCATED_BENCH_64 \
+    OBFUSCATED_BENCH_64 OBFUSCATED_BENCH_64 OBFUSCATED_BENCH_64 OBFUSCATED_BENCH_64 \
+    OBFUSCATED_BENCH_64 OBFUSCATED_BENCH_64 OBFUSCATED_BENCH_64 OBFUSCATED_BENCH_64
+#define OBFUSCATED_BENCH_4K OBFUSCATED_BENCH_1K OBFUSCATED_BENCH_1K OBFUSCATED_BENCH_1K OBFUSCATED_BENCH_1K
+
+namespace
+{
+    constexpr auto s0 = OBFUSCATE(OBFUSCATED_BENCH_4K);
+    constexpr auto s1 = OBFUSCATE(OBFUSCATED_BENCH_4K);
+    constexpr auto s2 = OBFUSCATE(OBFUSCATED_BENCH_4K);
+    constexpr auto s3 = OBFUSCATE(OBFUSCATED_BENCH_4K);
+    constexpr auto s4 = OBFUSCATE(OBFUSCATED_BENCH_4K);
+    constexpr auto s5 = OBFUSCATE(OBFUSCATED_BENCH_4K);
+    constexpr auto s6 = OBFUSCATE(OBFUSCATED_BENCH_4K);
+    constexpr auto s7 = OBFUSCATE(OBFUSCATED_BENCH_4K);
+    constexpr auto s8 = OBFUSCATE(OBFUSCATED_BENCH_4K);
+    constexpr auto s9 = OBFUSCATE(OBFUSCATED_BENCH_4K);
+    constexpr auto s10 = OBFUSCATE(OBFUSCATED_BENCH_4K);
+    constexpr auto s11 = OBFUSCATE(OBFUSCATED_BENCH_4K);
+    constexpr auto s12 = OBFUSCATE(OBFUSCATED_BENCH_4K);
+    constexpr auto s13 = OBFUSCATE(OBFUSCATED_BENCH_4K);
+    constexpr auto s14 = OBFUSCATE(OBFUSCATED_BENCH_4K);
+    constexpr auto s15 = OBFUSCATE(OBFUSCATED_BENCH_4K);
+}
+
+std::size_t obfuscated_compile_bench_size()
+{
+    return s0.string().size() + s1.string().size() + s2.string().size() + s3.string().size() + s4.string().size() + s5.string().size() + s6.string().size() + s7.string().size() +
+        s8.string().size() + s9.string().size() + s10.string().size() + s11.string().size() + s12.string().size() + s13.string().size() + s14.string().size() + s15.string().size();
+}
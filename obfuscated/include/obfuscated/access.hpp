@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "obfuscated/obfuscated_string.hpp"
+
+namespace obfuscated
+{
+    namespace detail
+    {
+        // Zero memory in a way the compiler can't skip as a dead store (which it may do with a plain memset of something about to go out of scope)
+        inline void wipe(void* p, std::size_t size)
+        {
+#if defined(__GNUC__)
+            std::memset(p, 0, size);
+            __asm__ __volatile__("" : : "r"(p) : "memory");
+#else
+            auto bytes = static_cast<volatile unsigned char*>(p);
+            for (std::size_t i = 0; i < size; ++i) { bytes[i] = 0; }
+#endif
+        }
+    }
+
+    // For a secret read often: decoded the first time it's read (by whichever thread gets there first), and kept decoded from then on, so every other read is just a load and a branch. The decoded copy is wiped when the cache is destroyed.
+    // Typically a static, made in place: `static const obfuscated::cached_string<char> key{ OBFUSCATE("...") };`
+    template<typename TChar>
+    class cached_string
+    {
+    public:
+        template<std::size_t N, std::uint64_t Seed>
+        explicit cached_string(obfuscated_string<TChar, N, Seed> const& s) : _source{ new source<obfuscated_string<TChar, N, Seed>>{ s } } {}
+
+        cached_string(cached_string const&) = delete;
+        cached_string& operator=(cached_string const&) = delete;
+
+        ~cached_string()
+        {
+            if (!_decoded.empty()) { detail::wipe(&_decoded[0], _decoded.size() * sizeof(TChar)); }
+        }
+
+        std::basic_string<TChar> const& get() const
+        {
+            if (!_ready.load(std::memory_order_acquire))
+            {
+                std::unique_lock<std::mutex> guard{ _mutex };
+                if (!_ready.load(std::memory_order_relaxed))
+                {
+                    // Decoded straight into the cache's own string, so there's no other copy of the plain text to wipe
+                    _decoded.assign(_source->size(), TChar{});
+                    if (!_decoded.empty()) { _source->decode_into(&_decoded[0], _decoded.size()); }
+                    // The encoded copy isn't needed any more
+                    _source.reset();
+                    _ready.store(true, std::memory_order_release);
+                }
+            }
+            return _decoded;
+        }
+
+        operator std::basic_string<TChar> const&() const { return get(); }
+
+    private:
+        // The encoded string, held by value until it's decoded, behind an interface which doesn't depend on its length or seed
+        struct source_base
+        {
+            virtual ~source_base() = default;
+            virtual std::size_t size() const = 0;
+            virtual void decode_into(TChar* buffer, std::size_t buffer_size) const = 0;
+        };
+
+        template<typename TString>
+        struct source : source_base
+        {
+            explicit source(TString const& s) : string{ s } {}
+            std::size_t size() const override { return TString::size(); }
+            void decode_into(TChar* buffer, std::size_t buffer_size) const override { string.decode_into(buffer, buffer_size); }
+
+            TString string;
+        };
+
+        mutable std::atomic<bool> _ready{ false };
+        mutable std::mutex _mutex;
+        mutable std::unique_ptr<source_base const> _source;
+        mutable std::basic_string<TChar> _decoded;
+    };
+
+    // For a secret that shouldn't linger: decoded into a buffer inside the view itself (so on the stack, for a local), never onto the heap, and wiped as soon as the view goes out of scope. The buffer is null-terminated, for C APIs.
+    template<typename TChar, std::size_t N>
+    class scoped_view
+    {
+    public:
+        template<std::uint64_t Seed>
+        explicit scoped_view(obfuscated_string<TChar, N, Seed> const& s)
+        {
+            s.decode_into(_buffer, N);
+            _buffer[N] = TChar{};
+        }
+
+        // Moving leaves the source wiped (so a view can be returned from a function)
+        scoped_view(scoped_view&& other) noexcept
+        {
+            std::memcpy(_buffer, other._buffer, sizeof(_buffer));
+            detail::wipe(other._buffer, sizeof(other._buffer));
+        }
+
+        scoped_view(scoped_view const&) = delete;
+        scoped_view& operator=(scoped_view const&) = delete;
+        scoped_view& operator=(scoped_view&&) = delete;
+
+        ~scoped_view() { detail::wipe(_buffer, sizeof(_buffer)); }
+
+        static constexpr std::size_t size() { return N; }
+        TChar const* data() const { return _buffer; }
+        TChar const* c_str() const { return _buffer; }
+        TChar const* begin() const { return _buffer; }
+        TChar const* end() const { return _buffer + N; }
+
+    private:
+        TChar _buffer[N + 1];
+    };
+
+    template<typename TChar, std::size_t N, std::uint64_t Seed>
+    inline scoped_view<TChar, N> view(obfuscated_string<TChar, N, Seed> const& s)
+    {
+        return scoped_view<TChar, N>{ s };
+    }
+}
@@ -1,76 +1,179 @@
-
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 
 namespace obfuscated
 {
-    template<typename TChar, std::size_t N>
-    struct obfuscated_string_hash_helper
+    namespace detail
     {
-        constexpr static typename std::make_unsigned<TChar>::type hash(const char* s)
+        // FNV-1a, for turning strings (file names, times) into seeds
+        constexpr std::uint64_t hash(const char* s, std::uint64_t h = 0xcbf29ce484222325)
         {
-            return (obfuscated_string_hash_helper<TChar, N - 1>::hash(s) << 5) ^
-                   (obfuscated_string_hash_helper<TChar, N - 1>::hash(s) >> 3) ^
-                   obfuscated_string_hash_helper<TChar, N - 1>::hash(s) ^
-                   s[N - 1];
+            for (; *s; ++s)
+            {
+                h = (h ^ static_cast<unsigned char>(*s)) * 0x100000001b3;
+            }
+            return h;
         }
-    };
 
-    template<typename TChar>
-    struct obfuscated_string_hash_helper<TChar, 0>
-    {
-        constexpr static typename std::make_unsigned<TChar>::type hash(const char* s)
+        // FNV-1a over a string's characters (all of each one, however wide), for keying a string by its own contents
+        template<typename TChar>
+        constexpr std::uint64_t hash_chars(const TChar* s, std::size_t size, std::uint64_t h = 0xcbf29ce484222325)
         {
-            return 0;
+            using unsigned_type = typename std::make_unsigned<TChar>::type;
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                h = (h ^ static_cast<unsigned_type>(s[i])) * 0x100000001b3;
+            }
+            return h;
         }
-    };
 
-    template<typename TChar, std::size_t N>
-    class obfuscated_string
-    {
-    public:
-        constexpr explicit obfuscated_string(const TChar* s) : tail(encode(s[N - 1])), head(s) {};
-
-        std::basic_string<TChar> dump() const { return head.dump() + tail; }
+        // The splitmix64 finalizer: each output bit depends on every input bit
+        constexpr std::uint64_t mix(std::uint64_t z)
+        {
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            return z ^ (z >> 31);
+        }
 
-        std::basic_string<TChar> string() const { return head.string() + decode(tail); }
+        // The build time is passed in (by the OBFUSCATE macro) rather than read here, so this function is the same in every translation unit, whenever each was compiled
+        constexpr std::uint64_t seed(const char* file, std::uint64_t line, std::uint64_t counter, std::uint64_t build)
+        {
+            return mix(hash(file) ^ mix(line ^ (counter << 32)) ^ build);
+        }
 
-        operator std::basic_string<TChar>() const { return string(); }
+        // The keystream, in counter mode: block k is the mix of the seed and k, so any part of it can be worked out without the rest (each character can be encoded at compile time on its own, and decoding goes a whole block at a time)
+        constexpr std::uint64_t keystream_block(std::uint64_t seed, std::size_t k)
+        {
+            return mix(seed + (k + 1) * 0x9e3779b97f4a7c15);
+        }
 
-    private:
-        TChar                           tail;
-        obfuscated_string<TChar, N - 1> head;
+        // A plain array of characters, which (unlike std::array, before C++17) can be filled in by a loop at compile time. (It always has room for one, so it's a valid array even when empty.)
+        template<typename TChar, std::size_t N>
+        struct char_array
+        {
+            TChar data[N == 0 ? 1 : N];
+        };
 
-        template<std::size_t M>
-        static constexpr typename std::make_unsigned<TChar>::type hash(const char(& s)[M])
+        // Encode a whole string at compile time, one keystream block at a time
+        template<typename TChar, std::size_t N>
+        constexpr char_array<TChar, N> encode(const TChar* s, std::uint64_t seed)
         {
-            return obfuscated_string_hash_helper<TChar, M - 1>::hash(s);
+            using unsigned_type = typename std::make_unsigned<TChar>::type;
+            constexpr std::size_t per_block = sizeof(std::uint64_t) / sizeof(TChar);
+            char_array<TChar, N> encoded{};
+            for (std::size_t i = 0, k = 0; i < N; i += per_block, ++k)
+            {
+                auto key = keystream_block(seed, k);
+                for (std::size_t j = 0; j < per_block && i + j < N; ++j)
+                {
+                    encoded.data[i + j] = static_cast<TChar>(static_cast<unsigned_type>(s[i + j]) ^ static_cast<unsigned_type>(key >> (j * 8 * sizeof(TChar))));
+                }
+            }
+            return encoded;
         }
 
-        static constexpr typename std::make_unsigned<TChar>::type salt = typename std::make_unsigned<TChar>::type{ 0x80 | (N + hash(__TIME__)) };
-
-        static constexpr TChar encode(TChar c) { return c + salt; }
+        // Hide a value from the optimizer, so it can't work the keystream out at compile time and fold the decoding away (which would put the plain text back in the binary, and take the compiler a long time to do)
+        inline std::uint64_t opaque(std::uint64_t value)
+        {
+#if defined(__GNUC__)
+            __asm__("" : "+r"(value));
+            return value;
+#else
+            volatile std::uint64_t copy = value;
+            return copy;
+#endif
+        }
 
-        static constexpr TChar decode(TChar c) { return c - salt; }
-    };
+        // XOR each character with its part of the keystream (encoding and decoding are the same). Characters are packed into blocks from the low bits up; on little-endian machines, that's memory order, so byte-sized characters go 8 at a time.
+        template<typename TChar>
+        inline void apply_keystream(const TChar* in, TChar* out, std::size_t size, std::uint64_t seed)
+        {
+            using unsigned_type = typename std::make_unsigned<TChar>::type;
+            constexpr std::size_t per_block = sizeof(std::uint64_t) / sizeof(TChar);
+            std::size_t i = 0;
+            std::size_t k = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            if (sizeof(TChar) == 1)
+            {
+                for (; i + per_block <= size; i += per_block, ++k)
+                {
+                    std::uint64_t block;
+                    std::memcpy(&block, in + i, sizeof(block));
+                    block ^= keystream_block(seed, k);
+                    std::memcpy(out + i, &block, sizeof(block));
+                }
+            }
+#endif
+            for (; i < size; i += per_block, ++k)
+            {
+                auto key = keystream_block(seed, k);
+                for (std::size_t j = 0; j < per_block && i + j < size; ++j)
+                {
+                    out[i + j] = static_cast<TChar>(static_cast<unsigned_type>(in[i + j]) ^ static_cast<unsigned_type>(key >> (j * 8 * sizeof(TChar))));
+                }
+            }
+        }
+    }
 
-    template<typename TChar>
-    class obfuscated_string<TChar, 0>
+    // A string literal kept in the binary only in encoded form, and decoded on demand. The encoded characters are held flat in an array (encoded by a loop at compile time), and all decoded in one pass, into a single string (or a buffer supplied by the caller, for no allocation at all).
+    // Each character is XORed with a keystream generated from a 64-bit key, made from the seed and a hash of the string itself, so no two different strings share a keystream (and XORing two encodings tells nothing about the two plain texts). Through the OBFUSCATE macro, each string also gets a seed of its own, from the file, line and a counter (and the build time), so even the same text encodes differently in two places; obfuscate() called directly has no seed, and keys each string by its contents alone.
+    template<typename TChar, std::size_t N, std::uint64_t Seed = 0>
+    class obfuscated_string
     {
     public:
-        constexpr explicit obfuscated_string(const TChar* s) {};
+        constexpr explicit obfuscated_string(const TChar* s) : _key(detail::mix(Seed ^ detail::hash_chars(s, N))), _encoded(detail::encode<TChar, N>(s, _key)) {}
 
-        std::basic_string<TChar> dump() const { return std::basic_string<TChar>(); }
+        static constexpr std::size_t size() { return N; }
 
-        std::basic_string<TChar> string() const { return std::basic_string<TChar>(); }
+        std::basic_string<TChar> dump() const { return std::basic_string<TChar>(_encoded.data, N); }
+
+        std::basic_string<TChar> string() const
+        {
+            std::basic_string<TChar> result(N, TChar{});
+            if (N != 0) { detail::apply_keystream(_encoded.data, &result[0], N, detail::opaque(_key)); }
+            return result;
+        }
 
         operator std::basic_string<TChar>() const { return string(); }
+
+        // Decode into the caller's buffer (which must have room for at least size() characters; no terminator is written), returning the number of characters written
+        std::size_t decode_into(TChar* buffer, std::size_t buffer_size) const
+        {
+            if (buffer_size < N) { throw std::length_error{ "buffer too small for obfuscated string" }; }
+            detail::apply_keystream(_encoded.data, buffer, N, detail::opaque(_key));
+            return N;
+        }
+
+        template<std::size_t M>
+        std::size_t decode_into(TChar (&buffer)[M]) const
+        {
+            static_assert(M >= N, "buffer too small for obfuscated string");
+            return decode_into(buffer, M);
+        }
+
+    private:
+        std::uint64_t _key;
+        detail::char_array<TChar, N> _encoded;
     };
 
+    template<std::uint64_t Seed, typename TChar, std::size_t N>
+    inline constexpr obfuscated_string<TChar, N - 1, Seed> obfuscate(const TChar(& plaintext)[N])
+    {
+        return obfuscated_string<TChar, N - 1, Seed>(plaintext);
+    }
+
     template<typename TChar, std::size_t N>
     inline constexpr obfuscated_string<TChar, N - 1> obfuscate(const TChar(& plaintext)[N])
     {
         return obfuscated_string<TChar, N - 1>(plaintext);
     }
 }
+
+// Obfuscate a string literal with a seed of its own
+#define OBFUSCATE(s) (::obfuscated::obfuscate<::obfuscated::detail::seed(__FILE__, __LINE__, __COUNTER__, ::obfuscated::detail::hash(__DATE__ " " __TIME__))>(s))
@@ -1,8 +1,15 @@
 
 #include <gtest/gtest.h>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <set>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "obfuscated/access.hpp"
 #include "obfuscated/obfuscated_string.hpp"
 
 TEST(ObfuscatedString, Test)
@@ -15,3 +22,107 @@ TEST(ObfuscatedString, Test)
 
     SUCCEED();
 }
+
+TEST(ObfuscatedString, Decode)
+{
+    constexpr auto s = obfuscated::obfuscate("The quick brown fox jumps over the lazy dog, twice: the quick brown fox jumps over the lazy dog");
+    ASSERT_EQ(s.size(), 95u);
+    ASSERT_EQ(std::string{ s }, "The quick brown fox jumps over the lazy dog, twice: the quick brown fox jumps over the lazy dog");
+    ASSERT_NE(s.dump(), std::string{ s });
+
+    constexpr auto w = obfuscated::obfuscate(L"wide");
+    ASSERT_EQ(std::wstring{ w }, L"wide");
+
+    constexpr auto empty = obfuscated::obfuscate("");
+    ASSERT_EQ(std::string{ empty }, "");
+}
+
+TEST(ObfuscatedString, DecodeInto)
+{
+    constexpr auto s = obfuscated::obfuscate("0123456789abcdef0123");
+    char buffer[32] = {};
+    ASSERT_EQ(s.decode_into(buffer), 20u);
+    ASSERT_EQ(std::string(buffer), "0123456789abcdef0123");
+    char small[8];
+    ASSERT_THROW(s.decode_into(small, sizeof(small)), std::length_error);
+}
+
+TEST(ObfuscatedString, NotInBinary)
+{
+    constexpr auto s = obfuscated::obfuscate("Another SECRET, which the binary shouldn't contain");
+    std::ifstream file{ "/proc/self/exe", std::ios::binary };
+    if (!file) { return; }
+    std::string binary{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+    ASSERT_EQ(binary.find(std::string{ s }), std::string::npos);
+}
+
+TEST(ObfuscatedString, Keystream)
+{
+    constexpr auto a = OBFUSCATE("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+    constexpr auto b = OBFUSCATE("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+    ASSERT_EQ(std::string{ a }, "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+    ASSERT_EQ(std::string{ b }, "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+    // Each string has its own key, and the same character doesn't encode the same way twice
+    ASSERT_NE(a.dump(), b.dump());
+    auto encoded = a.dump();
+    ASSERT_GT(std::set<char>(encoded.begin(), encoded.end()).size(), 8u);
+
+    // Strings of the same length, even without a seed, don't share a keystream (or XORing their encodings would give the XOR of their plain texts)
+    constexpr auto c = obfuscated::obfuscate("first secret, 24 chars..");
+    constexpr auto d = obfuscated::obfuscate("other secret, 24 chars!!");
+    static_assert(c.size() == d.size(), "the strings should be the same length");
+    auto c_key = c.dump();
+    auto d_key = d.dump();
+    auto c_text = std::string{ c };
+    auto d_text = std::string{ d };
+    for (std::size_t i = 0; i < c.size(); ++i)
+    {
+        c_key[i] ^= c_text[i];
+        d_key[i] ^= d_text[i];
+    }
+    ASSERT_NE(c_key, d_key);
+
+    constexpr auto u = OBFUSCATE(u"sixteen-bit characters");
+    ASSERT_EQ(std::u16string{ u }, u"sixteen-bit characters");
+    constexpr auto w = OBFUSCATE(L"wide characters, long enough to take a few blocks");
+    ASSERT_EQ(std::wstring{ w }, L"wide characters, long enough to take a few blocks");
+}
+
+TEST(ObfuscatedString, Cached)
+{
+    obfuscated::cached_string<char> const s{ OBFUSCATE("a secret read from many threads at once") };
+    std::vector<std::thread> threads;
+    std::vector<std::string const*> seen(8);
+    for (std::size_t i = 0; i < seen.size(); ++i)
+    {
+        threads.emplace_back([&s, &seen, i]() { seen[i] = &s.get(); });
+    }
+    for (auto& t : threads) { t.join(); }
+    // Decoded once, and shared by every reader
+    for (auto p : seen) { ASSERT_EQ(p, &s.get()); }
+    ASSERT_EQ(s.get(), "a secret read from many threads at once");
+    std::string const& r = s;
+    ASSERT_EQ(&r, &s.get());
+
+    obfuscated::cached_string<wchar_t> const w{ OBFUSCATE(L"wide") };
+    ASSERT_EQ(w.get(), L"wide");
+}
+
+TEST(ObfuscatedString, Scoped)
+{
+    constexpr auto s = OBFUSCATE("a secret that shouldn't linger");
+    {
+        auto v = obfuscated::view(s);
+        ASSERT_EQ(v.size(), 30u);
+        ASSERT_EQ(std::string(v.c_str()), "a secret that shouldn't linger");
+        ASSERT_EQ(std::string(v.begin(), v.end()), "a secret that shouldn't linger");
+
+        auto moved = std::move(v);
+        ASSERT_EQ(std::string(moved.c_str()), "a secret that shouldn't linger");
+        ASSERT_EQ(std::string(v.c_str()), "");
+    }
+
+    constexpr auto empty = OBFUSCATE("");
+    auto e = obfuscated::view(empty);
+    ASSERT_EQ(std::string(e.c_str()), "");
+}